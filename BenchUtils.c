@@ -0,0 +1,259 @@
+#include "BenchUtils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+  #define BILLION 1000000000L
+
+  // two-sided 97.5% quantiles of Student's t distribution for 1 to 30 
+  // degrees of freedom; beyond that the normal quantile is close enough
+  static const double t_quantiles[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+  #define NORMAL_QUANTILE 1.960
+
+  double bench_now(void){
+    struct timespec now;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (double) now.tv_sec + (double) now.tv_nsec / BILLION;
+  }
+
+  static int compare_doubles(const void *a, const void *b){
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+  }
+
+  // p-th quantile of n sorted values, interpolating between the two nearest
+  static double quantile(const double *sorted, int n, double p){
+    double pos = p * (n - 1);
+    int lower = (int) pos;
+    if(lower + 1 >= n){
+      return sorted[n - 1];
+    }
+    return sorted[lower] + (pos - lower) * (sorted[lower + 1] - sorted[lower]);
+  }
+
+  void compute_stats(const double *timings, int n, struct bench_stats *stats){
+    stats->samples = n;
+    if(n == 0){
+      *stats = (struct bench_stats) { 0 };
+      return;
+    }
+    // order statistics come from a sorted copy, so the timings stay in the
+    // order they were taken
+    double *sorted = malloc(n * sizeof(double));
+    memcpy(sorted, timings, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_doubles);
+    stats->min = sorted[0];
+    stats->max = sorted[n - 1];
+    stats->median = quantile(sorted, n, 0.5);
+    stats->p95 = quantile(sorted, n, 0.95);
+    free(sorted);
+
+    double sum = 0;
+    for(int i = 0; i < n; i++){
+      sum += timings[i];
+    }
+    stats->mean = sum / n;
+
+    double squares = 0;
+    for(int i = 0; i < n; i++){
+      squares += (timings[i] - stats->mean) * (timings[i] - stats->mean);
+    }
+    // a single timing says nothing about the spread, so the deviation and
+    // the interval are unknown rather than 0
+    if(n < 2){
+      stats->stddev = stats->ci_low = stats->ci_high = NAN;
+      return;
+    }
+    stats->stddev = sqrt(squares / (n - 1));
+
+    double t = n - 1 > 30 ? NORMAL_QUANTILE : t_quantiles[n - 2];
+    double margin = t * stats->stddev / sqrt(n);
+    stats->ci_low = stats->mean - margin;
+    stats->ci_high = stats->mean + margin;
+  }
+
+  // STREAM array length (three arrays of doubles, 192MB in all: well 
+  // beyond any last level cache) and number of timed runs
+  #define STREAM_ELEMENTS (8 * 1024 * 1024)
+  #define STREAM_RUNS 5
+  #define TRIAD_SCALAR 3.0
+
+  // what the team of STREAM threads does next
+  enum stream_step { INIT_STEP, COPY_STEP, TRIAD_STEP, STOP_STEP };
+
+  // the threads are started once and line up on a barrier before and after
+  // each step, so only the kernels themselves are timed
+  struct stream_team {
+    int threads;
+    double *a;
+    double *b;
+    double *c;
+    enum stream_step step;
+    pthread_mutex_t setup;      // held until the barriers are set up
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+  };
+
+  struct stream_member {
+    struct stream_team *team;
+    int index;
+    double start;               // when this thread's last step ran
+    double end;
+  };
+
+  // do one step over this thread's share of the arrays (the same share for
+  // every step, so with INIT_STEP touching the pages first each thread 
+  // streams through memory on its own NUMA node)
+  static void run_stream_step(struct stream_member *member){
+    struct stream_team *team = member->team;
+    int index = member->index;
+    member->start = bench_now();
+    long begin = (long) STREAM_ELEMENTS * index / team->threads;
+    long end = (long) STREAM_ELEMENTS * (index + 1) / team->threads;
+    double *restrict a = team->a;
+    const double *restrict b = team->b;
+    const double *restrict c = team->c;
+    if(team->step == INIT_STEP){
+      for(long i = begin; i < end; i++){
+        team->a[i] = 0;
+        team->b[i] = 1;
+        team->c[i] = 2;
+      }
+    } else if(team->step == COPY_STEP){
+      for(long i = begin; i < end; i++){
+        a[i] = b[i];
+      }
+    } else {
+      for(long i = begin; i < end; i++){
+        a[i] = b[i] + TRIAD_SCALAR * c[i];
+      }
+    }
+    member->end = bench_now();
+  }
+
+  static void *stream_member_thread(void *arg){
+    struct stream_member *member = arg;
+    struct stream_team *team = member->team;
+    pthread_mutex_lock(&team->setup);
+    pthread_mutex_unlock(&team->setup);
+    while(true){
+      pthread_barrier_wait(&team->start);
+      if(team->step == STOP_STEP){
+        return NULL;
+      }
+      run_stream_step(member);
+      pthread_barrier_wait(&team->done);
+    }
+  }
+
+  // run a step with the whole team (the caller is member 0), returning the
+  // time from when the first thread started it to when the last one was 
+  // done (each thread times itself, so the barriers are left out even when
+  // the threads do not all run at once)
+  static double time_stream_step(struct stream_member *members, enum stream_step step){
+    struct stream_team *team = members[0].team;
+    team->step = step;
+    pthread_barrier_wait(&team->start);
+    run_stream_step(&members[0]);
+    pthread_barrier_wait(&team->done);
+    double start = members[0].start;
+    double end = members[0].end;
+    for(int t = 1; t < team->threads; t++){
+      start = fmin(start, members[t].start);
+      end = fmax(end, members[t].end);
+    }
+    return end - start;
+  }
+
+  void measure_stream_bandwidth(int threads, struct stream_bandwidth *bandwidth){
+    struct stream_team team = { .threads = threads < 1 ? 1 : threads };
+    team.a = malloc(STREAM_ELEMENTS * sizeof(double));
+    team.b = malloc(STREAM_ELEMENTS * sizeof(double));
+    team.c = malloc(STREAM_ELEMENTS * sizeof(double));
+    pthread_t *ids = malloc(team.threads * sizeof(pthread_t));
+    struct stream_member *members = malloc(team.threads * sizeof(struct stream_member));
+    if(team.a == NULL || team.b == NULL || team.c == NULL || ids == NULL || members == NULL){
+      bandwidth->copy = bandwidth->triad = NAN;
+      free(team.a);
+      free(team.b);
+      free(team.c);
+      free(ids);
+      free(members);
+      return;
+    }
+
+    // the team is whichever threads could be started
+    pthread_mutex_init(&team.setup, NULL);
+    pthread_mutex_lock(&team.setup);
+    members[0] = (struct stream_member) { .team = &team, .index = 0 };
+    int started = 1;
+    for(; started < team.threads; started++){
+      members[started] = (struct stream_member) { .team = &team, .index = started };
+      if(pthread_create(&ids[started], NULL, stream_member_thread, &members[started]) != 0){
+        break;
+      }
+    }
+    team.threads = started;
+    pthread_barrier_init(&team.start, NULL, team.threads);
+    pthread_barrier_init(&team.done, NULL, team.threads);
+    pthread_mutex_unlock(&team.setup);
+
+    // touching the arrays first keeps page faults out of the timings
+    time_stream_step(members, INIT_STEP);
+    double best_copy = INFINITY;
+    double best_triad = INFINITY;
+    for(int run = 0; run < STREAM_RUNS; run++){
+      best_copy = fmin(best_copy, time_stream_step(members, COPY_STEP));
+      best_triad = fmin(best_triad, time_stream_step(members, TRIAD_STEP));
+    }
+    bandwidth->copy = 2.0 * sizeof(double) * STREAM_ELEMENTS / best_copy;
+    bandwidth->triad = 3.0 * sizeof(double) * STREAM_ELEMENTS / best_triad;
+
+    team.step = STOP_STEP;
+    pthread_barrier_wait(&team.start);
+    for(int t = 1; t < team.threads; t++){
+      pthread_join(ids[t], NULL);
+    }
+    pthread_barrier_destroy(&team.start);
+    pthread_barrier_destroy(&team.done);
+    pthread_mutex_destroy(&team.setup);
+    free(team.a);
+    free(team.b);
+    free(team.c);
+    free(ids);
+    free(members);
+  }
+
+  void write_json_string(FILE *f, const char *s){
+    fputc('"', f);
+    for(; *s != '\0'; s++){
+      if(*s == '"' || *s == '\\'){
+        fputc('\\', f);
+        fputc(*s, f);
+      } else if((unsigned char) *s < ' '){
+        fprintf(f, "\\u%04x", *s);
+      } else {
+        fputc(*s, f);
+      }
+    }
+    fputc('"', f);
+  }
+
+  void write_json_number(FILE *f, double value, int decimals){
+    if(!isfinite(value)){
+      fprintf(f, "null");
+      return;
+    }
+    fprintf(f, "%.*f", decimals, value);
+  }
@@ -0,0 +1,48 @@
+#ifndef BENCHUTILS_H
+#define BENCHUTILS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+  // Timing and summary statistics for the experiments.
+
+  // summary of a set of timings, in seconds
+  struct bench_stats {
+    int samples;
+    double min;
+    double median;
+    double p95;
+    double max;
+    double mean;
+    double stddev;          // sample standard deviation
+    double ci_low;          // 95% confidence interval of the mean 
+    double ci_high;         // (Student's t); these three are NAN for one sample
+  };
+
+  // current time in seconds, from a monotonic clock that is not adjusted 
+  // (slewed) by NTP, so that differences are true elapsed times
+  double bench_now(void);
+
+  // summarise n timings
+  void compute_stats(const double *timings, int n, struct bench_stats *stats);
+
+  // sustainable memory bandwidth in bytes per second, from STREAM-style
+  // kernels over arrays much bigger than the caches: copy (a[i] = b[i], 
+  // 16 bytes moved per element) and triad (a[i] = b[i] + k * c[i], 24)
+  struct stream_bandwidth {
+    double copy;
+    double triad;
+  };
+
+  // measure the bandwidth with the given number of threads (the best of a
+  // few runs, as STREAM reports)
+  void measure_stream_bandwidth(int threads, struct stream_bandwidth *bandwidth);
+
+  // write s to f as a JSON string literal
+  void write_json_string(FILE *f, const char *s);
+
+  // write value to f as a JSON number with the given number of decimals, 
+  // or as null if it is not finite (JSON has no infinity or NaN)
+  void write_json_number(FILE *f, double value, int decimals);
+
+#endif
@@ -1,62 +1,99 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
 #include "Utils.h"
 #include "Picture.h"
 #include "PicProcess.h"
-#include <time.h>
 #include <math.h>
 #include "BlurExprmt.h"
+#include "BenchUtils.h"
+#include "PerfCounters.h"
+#include "PicParallel.h"
+#include "WorkStealing.h"
 #include "thpool/thpool.h"
+#include <unistd.h>
+#include <stdatomic.h>
 
 #define BLUR_REGION_SIZE 9
-#define BILLION  1000000000L
 
-#define IMPLEMENTATIONS 7
 #define THREADLIMIT 100
+#define ENGINE_THREADS 4
+#define DEFAULT_BATCH 64
+#define DEFAULT_WARMUP 2
+
+// bytes of source and destination pixels a cache-sized tile may span
+#define CACHE_TILE_BYTES (256 * 1024)
+
+// sweep mode defaults: numbers of sectors and image sides, which can go up
+// to MAX_SWEEP_SIZE with --sizes
+#define DEFAULT_SECTORS "1,4,16,64,256"
+#define DEFAULT_BATCHES "1,16,256,4096"
+#define DEFAULT_SIZES "256,1024,4096"
+#define MAX_SWEEP_SIZE 16384
+#define MAX_SWEEP_VALUES 64
+
+// the pixel by pixel implementations make a task per pixel, which takes too
+// long (and too much memory) to sweep over the larger images
+#define PIXEL_TASK_SIZE_LIMIT 1024
 
 // ---------- MAIN PROGRAM ---------- \\
 
   static void *blur_chunk(void *);
   static void blur_chunk_thpool(void *);
   static void *do_tasks(void *);
-  static void blur_column_by_column(struct picture *);
-  static void blur_row_by_row(struct picture *);
-  static void blur_pixel_by_pixel_with_task_stack(struct picture *);
-  static void blur_pixel_by_pixel_with_thpool(struct picture *);
-  static void blur_sector_by_sector(struct picture *, int);
-
-  // Array storing file names
-  char *files_names[IMPLEMENTATIONS] = {
-    "experiment_images/base_blur.jpg", 
-    "experiment_images/row_by_row_blur.jpg", 
-    "experiment_images/column_by_column_blur.jpg", 
-    "experiment_images/pixel_by_pixel_stack_blur.jpg",
-    "experiment_images/pixel_by_pixel_thpool_blur.jpg", 
-    "experiment_images/few_sector_by_sector_blur.jpg", 
-    "experiment_images/many_sector_by_sector_blur.jpg"
-  };
-  // Array storing implementation names
-  char *implemenation_name[IMPLEMENTATIONS] = {
-    "Sequential", 
-    "Row by Row", 
-    "Column by Column", 
-    "Pixel by Pixel using stack of tasks", 
-    "Pixel by Pixel using thread pool", 
-    "Sector by Sector with 4 sectors", 
-    "Sector by Sector with 100 sectors" 
-  };
-  // Array storing the function pointers
-  blur_func functions[IMPLEMENTATIONS] = { 
-    &blur_picture, 
-    &blur_row_by_row, 
-    &blur_column_by_column, 
-    &blur_pixel_by_pixel_with_task_stack, 
-    &blur_pixel_by_pixel_with_thpool, 
-    &blur_sector_by_sector, 
-    &blur_sector_by_sector 
+  static void blur_sequential(struct picture *, const struct blur_config *);
+  static void blur_column_by_column(struct picture *, const struct blur_config *);
+  static void blur_row_by_row(struct picture *, const struct blur_config *);
+  static void blur_pixel_by_pixel_with_task_stack(struct picture *, const struct blur_config *);
+  static void blur_pixel_by_pixel_with_thpool(struct picture *, const struct blur_config *);
+  static void blur_sector_by_sector(struct picture *, const struct blur_config *);
+  static void blur_pixel_by_pixel_with_task_slab(struct picture *, const struct blur_config *);
+  static void blur_pixel_by_pixel_with_work_stealing(struct picture *, const struct blur_config *);
+  static void blur_pixel_by_pixel_with_atomic_counter(struct picture *, const struct blur_config *);
+  static void blur_parallel_engine(struct picture *, const struct blur_config *);
+  static void blur_stealing_engine(struct picture *, const struct blur_config *);
+
+  /*
+    Registry of the implementations, selectable by name on the command line.
+  */
+  static const struct implementation implementations[] = {
+    {"sequential", "Sequential", "experiment_images/base_blur.jpg", 
+      blur_sequential, {1, 0, 0}, NO_KNOB, 0},
+    {"row_by_row", "Row by Row", "experiment_images/row_by_row_blur.jpg", 
+      blur_row_by_row, {0, 0, 0}, NO_KNOB, 0},
+    {"column_by_column", "Column by Column", "experiment_images/column_by_column_blur.jpg", 
+      blur_column_by_column, {0, 0, 0}, NO_KNOB, 0},
+    {"pixel_stack", "Pixel by Pixel using stack of tasks", "experiment_images/pixel_by_pixel_stack_blur.jpg", 
+      blur_pixel_by_pixel_with_task_stack, {THREADLIMIT, 0, 0}, THREADS_KNOB, PIXEL_TASK_SIZE_LIMIT},
+    {"pixel_slab", "Pixel by Pixel using a slab of tasks", "experiment_images/pixel_by_pixel_slab_blur.jpg", 
+      blur_pixel_by_pixel_with_task_slab, {THREADLIMIT, 0, 0}, THREADS_KNOB, PIXEL_TASK_SIZE_LIMIT},
+    {"pixel_thpool", "Pixel by Pixel using thread pool", "experiment_images/pixel_by_pixel_thpool_blur.jpg", 
+      blur_pixel_by_pixel_with_thpool, {THREADLIMIT, 0, 0}, THREADS_KNOB, PIXEL_TASK_SIZE_LIMIT},
+    {"pixel_stealing", "Pixel by Pixel using work stealing", "experiment_images/pixel_by_pixel_stealing_blur.jpg", 
+      blur_pixel_by_pixel_with_work_stealing, {ENGINE_THREADS, 0, 0}, THREADS_KNOB, 0},
+    {"pixel_atomic", "Pixel by Pixel using atomic batches", "experiment_images/pixel_by_pixel_atomic_blur.jpg", 
+      blur_pixel_by_pixel_with_atomic_counter, {THREADLIMIT, 0, DEFAULT_BATCH}, THREADS_KNOB | BATCH_KNOB, 0},
+    {"few_sectors", "Sector by Sector with 4 sectors", "experiment_images/few_sector_by_sector_blur.jpg", 
+      blur_sector_by_sector, {0, 4, 0}, SECTORS_KNOB, 0},
+    {"many_sectors", "Sector by Sector with 100 sectors", "experiment_images/many_sector_by_sector_blur.jpg", 
+      blur_sector_by_sector, {0, 100, 0}, NO_KNOB, 0},
+    {"strip_sectors", "Sector by Sector with 4 strips", "experiment_images/strip_sector_by_sector_blur.jpg", 
+      blur_sector_by_sector, {0, 4, 0, STRIP_TILES}, SECTORS_KNOB, 0},
+    {"cache_tiles", "Sector by Sector with cache tiles", "experiment_images/cache_tile_blur.jpg", 
+      blur_sector_by_sector, {ENGINE_THREADS, 0, 0, CACHE_TILES}, THREADS_KNOB, 0},
+    {"parallel_engine", "Tiled parallel engine (PicParallel)", "experiment_images/parallel_engine_blur.jpg", 
+      blur_parallel_engine, {ENGINE_THREADS, 0, 0}, THREADS_KNOB, 0},
+    {"stealing_engine", "Work-stealing parallel engine", "experiment_images/stealing_engine_blur.jpg", 
+      blur_stealing_engine, {ENGINE_THREADS, 0, 0}, THREADS_KNOB, 0}
   };
 
+  static int no_of_implementations = sizeof(implementations) / sizeof(implementations[0]);
+
+  /*
+    Names of the pinnings, for --pin and the results.
+  */
+  static const char *pinning_names[] = { "none", "core", "node" };
 
   /*
     Global stack of args threads in thread pixel can pull from.
@@ -67,6 +104,29 @@
     Lock used for the global stack when popping.
   */
   pthread_mutex_t task_list_lock;
+
+  /*
+    Global slab of tasks threads in pixel_slab pop from (under task_list_lock).
+  */
+  task_slab_t task_slab;
+
+  /*
+    When the implementation being timed finished setting up its tasks (NAN 
+    if it does not say); the rest of its time is compute time.
+  */
+  double setup_done;
+
+  /*
+    Performance counters collected around every timed run (with --counters).
+  */
+  bool counters_enabled = false;
+  struct perf_counters counters;
+
+  /*
+    Memory bandwidth of the host, measured at startup to compare the 
+    implementations' throughput with.
+  */
+  struct stream_bandwidth stream;
   
   /*
     Funcition to pop from the stack.
@@ -95,6 +155,31 @@
     list->size++;
   }
 
+  /*
+    Blurs the pixel (i, j) of pic, reading the unblurred picture from tmp.
+  */
+  static void blur_pixel(struct picture *pic, struct picture *tmp, int i, int j){
+    struct pixel rgb;  
+    int sum_red = 0;
+    int sum_green = 0;
+    int sum_blue = 0;
+  
+    for(int n = -1; n <= 1; n++){
+      for(int m = -1; m <= 1; m++){
+        rgb = get_pixel(tmp, i+n, j+m);
+        sum_red += rgb.red;
+        sum_green += rgb.green;
+        sum_blue += rgb.blue;
+      }
+    }
+  
+    rgb.red = sum_red / BLUR_REGION_SIZE;
+    rgb.green = sum_green / BLUR_REGION_SIZE;
+    rgb.blue = sum_blue / BLUR_REGION_SIZE;
+  
+    set_pixel(pic, i, j, &rgb);
+  }
+
   /*
     Generic bluring function to pass to the threads with the args.
   */
@@ -102,25 +187,7 @@
     struct task_args *args = (struct task_args *) args_ptr;
     for(int i = args->i_start; i < args->i_end + 1; i++){
       for(int j = args->j_start; j < args->j_end + 1; j++){
-        struct pixel rgb;  
-        int sum_red = 0;
-        int sum_green = 0;
-        int sum_blue = 0;
-      
-        for(int n = -1; n <= 1; n++){
-          for(int m = -1; m <= 1; m++){
-            rgb = get_pixel(&args->tmp, i+n, j+m);
-            sum_red += rgb.red;
-            sum_green += rgb.green;
-            sum_blue += rgb.blue;
-          }
-        }
-      
-        rgb.red = sum_red / BLUR_REGION_SIZE;
-        rgb.green = sum_green / BLUR_REGION_SIZE;
-        rgb.blue = sum_blue / BLUR_REGION_SIZE;
-      
-        set_pixel(args->pic, i, j, &rgb);
+        blur_pixel(args->pic, &args->tmp, i, j);
       }
     }
   }
@@ -147,14 +214,57 @@
     pthread_mutex_unlock(&task_list_lock);
   }
 
+  /*
+    Function to give to blur pixel which pops tasks from the slab, the same
+    way do_tasks pops them from the list.
+  */
+  static void *do_slab_tasks(void *UNUSED) {
+    pthread_mutex_lock(&task_list_lock);
+    while(task_slab.size != 0) {
+      struct pixel_task *task = &task_slab.tasks[--task_slab.size];
+      pthread_mutex_unlock(&task_list_lock);
+      blur_pixel(task->job->pic, task->job->tmp, task->i, task->j);
+      pthread_mutex_lock(&task_list_lock);
+    }
+    pthread_mutex_unlock(&task_list_lock);
+    return NULL;
+  }
+
+  /*
+    The sequential blur, for comparison.
+  */
+  static void blur_sequential(struct picture *pic, const struct blur_config *unused){
+    blur_picture(pic);
+  }
+
+  /*
+    The blur of the parallel engine picture_lib uses. Its worker pool is 
+    persistent, so it is only (re)started when the thread count changes.
+  */
+  static void blur_parallel_engine(struct picture *pic, const struct blur_config *config){
+    if (get_worker_count() != config->threads || get_worker_kind() != POOL_WORKERS) {
+      init_workers(config->threads);
+    }
+    blur_picture_parallel(pic);
+  }
+
+  /*
+    The blur of the parallel engine, with the work-stealing scheduler 
+    cutting up its tiles in place of the thread pool.
+  */
+  static void blur_stealing_engine(struct picture *pic, const struct blur_config *config){
+    if (get_worker_count() != config->threads || get_worker_kind() != STEALING_WORKERS) {
+      init_workers_of(STEALING_WORKERS, config->threads);
+    }
+    blur_picture_parallel(pic);
+  }
+
   /*
     Bluring function that does bluring in a column by column manner.
   */
-  static void blur_column_by_column(struct picture *pic){
+  static void blur_column_by_column(struct picture *pic, const struct blur_config *unused){
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;  
+    init_picture_from_copy(&tmp, pic, pic->format);
     pthread_t *threads = (pthread_t *) malloc((tmp.width - 2) * sizeof(pthread_t));
     if (threads == NULL) {
       printf("Ran out of memory for malloc!\n");
@@ -187,11 +297,9 @@
   /*
     Bluring function that does bluring in a row by row manner.
   */
-  static void blur_row_by_row(struct picture *pic){
+  static void blur_row_by_row(struct picture *pic, const struct blur_config *unused){
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;  
+    init_picture_from_copy(&tmp, pic, pic->format);
     pthread_t *threads = (pthread_t *) malloc((tmp.height - 2) * sizeof(pthread_t));
     if (threads == NULL) {
       printf("Ran out of memory for malloc!\n");
@@ -225,14 +333,12 @@
     Bluring function that does bluring in a pixel by pixel manner using a stack
     of tasks.
   */
-  static void blur_pixel_by_pixel_with_task_stack(struct picture *pic){
+  static void blur_pixel_by_pixel_with_task_stack(struct picture *pic, const struct blur_config *config){
     task_list.head = NULL;
     task_list.size = 0;
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;  
-    pthread_t *threads = (pthread_t *) malloc(THREADLIMIT * sizeof(pthread_t));
+    init_picture_from_copy(&tmp, pic, pic->format);
+    pthread_t *threads = (pthread_t *) malloc(config->threads * sizeof(pthread_t));
     if (threads == NULL) {
       printf("Ran out of memory for malloc!\n");
       return;
@@ -253,33 +359,77 @@
         list_push(&task_list, task);
       }
     }
-    for (int i = 0; i < THREADLIMIT; i++){
+    setup_done = bench_now();
+    for (int i = 0; i < config->threads; i++){
       pthread_create(&threads[i], NULL, do_tasks, NULL);
     }
     
-    for(int i = 0; i < THREADLIMIT; i++){
+    for(int i = 0; i < config->threads; i++){
+      pthread_join(threads[i], NULL);
+    }
+
+    clear_picture(&tmp);
+    free(threads);
+  }
+
+  /*
+    Bluring function that does bluring in a pixel by pixel manner using a stack
+    of compact tasks allocated all at once from a slab, so the whole job takes
+    one allocation and one free instead of two per pixel.
+  */
+  static void blur_pixel_by_pixel_with_task_slab(struct picture *pic, const struct blur_config *config){
+    struct picture tmp;
+    init_picture_from_copy(&tmp, pic, pic->format);
+    struct pixel_job job = { pic, &tmp, tmp.width - 2 };
+    int pixels = (tmp.width - 2) * (tmp.height - 2);
+    task_slab.tasks = (struct pixel_task *) malloc(pixels * sizeof(struct pixel_task));
+    pthread_t *threads = (pthread_t *) malloc(config->threads * sizeof(pthread_t));
+    if (task_slab.tasks == NULL || threads == NULL) {
+      printf("Ran out of memory for malloc!\n");
+      clear_picture(&tmp);
+      free(task_slab.tasks);
+      free(threads);
+      return;
+    }
+    task_slab.size = 0;
+    for(int i = 1; i < tmp.width - 1; i++){
+      for(int j = 1; j < tmp.height - 1; j++){
+        task_slab.tasks[task_slab.size++] = (struct pixel_task) { &job, i, j };
+      }
+    }
+    setup_done = bench_now();
+    for (int i = 0; i < config->threads; i++){
+      pthread_create(&threads[i], NULL, do_slab_tasks, NULL);
+    }
+    
+    for(int i = 0; i < config->threads; i++){
       pthread_join(threads[i], NULL);
     }
 
     clear_picture(&tmp);
+    free(task_slab.tasks);
     free(threads);
   }
 
   /*
     Bluring function that does bluring in a pixel by pixel manner using a thread
-    pool.
+    pool. The jobs of each column of pixels are added to the pool in one batch.
   */
-  static void blur_pixel_by_pixel_with_thpool(struct picture *pic){
+  static void blur_pixel_by_pixel_with_thpool(struct picture *pic, const struct blur_config *config){
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;
+    init_picture_from_copy(&tmp, pic, pic->format);
     struct task_args *args = (struct task_args *) malloc((tmp.width - 2) * (tmp.height - 2) * sizeof(struct task_args));
     if (args == NULL) {
       printf("Ran out of memory for malloc!\n");
       return;
     }
-    threadpool thread_pool = thpool_init(THREADLIMIT);
+    void **column = (void **) malloc((tmp.height - 2) * sizeof(void *));
+    if (column == NULL) {
+      printf("Ran out of memory for malloc!\n");
+      free(args);
+      return;
+    }
+    threadpool thread_pool = thpool_init(config->threads);
     int index = 0;
     for(int i = 1; i < tmp.width - 1; i++){
       for(int j = 1; j < tmp.height - 1; j++){
@@ -289,240 +439,967 @@
         args[index].i_end = i;
         args[index].j_start = j;
         args[index].j_end = j;
-
-        thpool_add_work(thread_pool, blur_chunk_thpool, &args[index]);
+        column[j - 1] = &args[index];
 
         index++;
       }
+      thpool_add_work_batch(thread_pool, blur_chunk_thpool, column, tmp.height - 2);
     }
     thpool_wait(thread_pool);
     thpool_destroy(thread_pool);
 
     clear_picture(&tmp);
+    free(column);
     free(args);
   }
 
   /*
-    Bluring function that does bluring in a sector by sector manner.
-    The number of sectors is given in the sectors parameter, which has to
-    be a square number, as the image will be split into equal rectangles.
-    The rectangles at the edges of the image may have a slightly smaller
-    size than the other rectangles, if the image width and height are not
-    divisible by the root of the number of sectors.
-  */
-  static void blur_sector_by_sector(struct picture *pic, int sectors){
-    int split = sqrt(sectors);
+    Blurs the interior pixels numbered from first up to last.
+  */
+  static void blur_pixel_range(void *job_ptr, int first, int last){
+    struct pixel_job *job = (struct pixel_job *) job_ptr;
+    for(int k = first; k < last; k++){
+      blur_pixel(job->pic, job->tmp, 1 + k % job->inner_width, 1 + k / job->inner_width);
+    }
+  }
+
+  /*
+    Bluring function that does bluring in a pixel by pixel manner using a 
+    work-stealing scheduler: the range of pixels is split up recursively 
+    between the threads' own deques instead of being handed out a pixel at 
+    a time from one locked stack.
+  */
+  static void blur_pixel_by_pixel_with_work_stealing(struct picture *pic, const struct blur_config *config){
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;
-    pthread_t *threads = (pthread_t *) malloc(split * split * sizeof(pthread_t));
-    if (threads == NULL) {
-      printf("Ran out of memory for malloc!\n");
+    init_picture_from_copy(&tmp, pic, pic->format);
+    struct pixel_job job = { pic, &tmp, tmp.width - 2 };
+    struct stealing_pool *pool = stealing_pool_init(config->threads);
+    if (pool == NULL) {
+      printf("Could not start the work-stealing threads!\n");
       return;
     }
-    struct task_args *args = (struct task_args *) malloc(split * split * sizeof(struct task_args));
-    if (args == NULL) {
+    stealing_parallel_for(pool, 0, (tmp.width - 2) * (tmp.height - 2), 0, blur_pixel_range, &job);
+    stealing_pool_destroy(pool);
+
+    clear_picture(&tmp);
+  }
+
+  /*
+    Shared state of the atomic counter threads: the job, how many pixels 
+    there are and the number of the next one nobody has claimed yet.
+  */
+  struct counter_job {
+    struct pixel_job job;
+    int pixels;
+    int batch;
+    atomic_int next;
+  };
+
+  /*
+    Claims batches of pixels with a single atomic add each (no lock and no
+    list to pop from) until every pixel has been claimed.
+  */
+  static void *do_batches(void *job_ptr) {
+    struct counter_job *job = (struct counter_job *) job_ptr;
+    int first;
+    while ((first = atomic_fetch_add_explicit(&job->next, job->batch, memory_order_relaxed)) < job->pixels) {
+      int last = first + job->batch < job->pixels ? first + job->batch : job->pixels;
+      blur_pixel_range(&job->job, first, last);
+    }
+    return NULL;
+  }
+
+  /*
+    Bluring function that does bluring in a pixel by pixel manner, with the
+    threads claiming batches of pixels from a shared atomic counter.
+  */
+  static void blur_pixel_by_pixel_with_atomic_counter(struct picture *pic, const struct blur_config *config){
+    struct picture tmp;
+    init_picture_from_copy(&tmp, pic, pic->format);
+    struct counter_job job = { { pic, &tmp, tmp.width - 2 }, (tmp.width - 2) * (tmp.height - 2), config->batch };
+    atomic_init(&job.next, 0);
+    pthread_t *threads = (pthread_t *) malloc(config->threads * sizeof(pthread_t));
+    if (threads == NULL) {
       printf("Ran out of memory for malloc!\n");
       return;
     }
-
-    int i_start = 1;
-    int j_start = 1;
-    int i_end = tmp.width / split;
-    int j_end = tmp.height / split;
-    int x = 0;
-    int y = 0;
-
-    while (i_end < tmp.width - 1) {
-      while (j_end < tmp.height - 1) {
-        args[x * split + y].pic = pic;
-        args[x * split + y].tmp = tmp;
-        args[x * split + y].i_start = i_start;
-        args[x * split + y].i_end = i_end;
-        args[x * split + y].j_start = j_start;
-        args[x * split + y].j_end = j_end;
-
-        pthread_create(&threads[x * split + y], NULL, blur_chunk, &args[x * split + y]);
-
-        j_start = j_end + 1;
-        j_end = j_end + (tmp.height / split) + 1;
-        y++;
-      }
-      // Edge case when image width is not divisible by the split
-      args[x * split + y].pic = pic;
-      args[x * split + y].tmp = tmp;
-      args[x * split + y].i_start = i_start;
-      args[x * split + y].i_end = i_end;
-      args[x * split + y].j_start = j_start;
-      args[x * split + y].j_end = tmp.height - 2;
-
-      pthread_create(&threads[x * split + y], NULL, blur_chunk, &args[x * split + y]);
-
-      y = 0;
-      j_start = 1;
-      j_end = tmp.height / split;
-
-      i_start = i_end + 1;
-      i_end = i_end + (tmp.width / split) + 1;
-      x++;
-    }
-    // Edge case when image height is not divisible by the split
-    while (j_end < tmp.height - 1) {
-      args[x * split + y].pic = pic;
-      args[x * split + y].tmp = tmp;
-      args[x * split + y].i_start = i_start;
-      args[x * split + y].i_end = tmp.width - 2;
-      args[x * split + y].j_start = j_start;
-      args[x * split + y].j_end = j_end;
-
-      pthread_create(&threads[x * split + y], NULL, blur_chunk, &args[x * split + y]);
-
-      j_start = j_end + 1;
-      j_end = j_end + (tmp.height / split) + 1;
-      y++;
-    }
-    // Edge case when image width and height are not divisible by the split
-    args[x * split + y].pic = pic;
-    args[x * split + y].tmp = tmp;
-    args[x * split + y].i_start = i_start;
-    args[x * split + y].i_end = tmp.width - 2;
-    args[x * split + y].j_start = j_start;
-    args[x * split + y].j_end = tmp.height - 2;
-
-    pthread_create(&threads[x * split + y], NULL, blur_chunk, &args[x * split + y]);
-    for(int x = 0; x < split; x++){
-      for(int y = 0; y < split; y++){
-        pthread_join(threads[x * split + y], NULL);
-      }
+    for (int i = 0; i < config->threads; i++){
+      pthread_create(&threads[i], NULL, do_batches, &job);
+    }
+    for(int i = 0; i < config->threads; i++){
+      pthread_join(threads[i], NULL);
     }
 
     clear_picture(&tmp);
     free(threads);
-    free(args);
   }
 
+  /*
+    Chooses cols x rows = tiles for a width x height area, making the tiles
+    as close to square as the number of tiles allows (a prime number of 
+    tiles can only be cut into strips).
+  */
+  static void choose_grid(int tiles, int width, int height, int *cols, int *rows) {
+    double best = INFINITY;
+    *cols = 1;
+    *rows = tiles;
+    for (int c = 1; c <= tiles; c++) {
+      if (tiles % c != 0) {
+        continue;
+      }
+      double aspect = fabs(log(((double) width / c) / ((double) height / (tiles / c))));
+      if (aspect < best) {
+        best = aspect;
+        *cols = c;
+        *rows = tiles / c;
+      }
+    }
+  }
 
   /*
-    Checks whether a blurred image stored in a file is the same as 
-    base_blur.jpg, which is generated by running the sequential
-    blur_picture. (This is done as the first blur in the experiment, 
-    and is assumbed correct)
+    Cuts the interior of pic into tiles of the configured shape.
   */
-  static bool check_correctness(char *file) {
-    char command[500];
-    sprintf(command, "./picture_compare %s %s", files_names[0], file);
-    if (system(command) != 0) {
-      printf("\nPicture %s was not blurred correctly!\n", file);
-      return false;
+  static void make_tiling(struct picture *pic, const struct blur_config *config, struct tiling *tiling) {
+    int width = pic->width - 2;
+    int height = pic->height - 2;
+    tiling->pic = pic;
+    if (config->shape == CACHE_TILES) {
+      // source and destination tiles of every plane fit in the cache together
+      int pixel_bytes = pic->format == BYTE_PIXELS ? 1 : sizeof(float);
+      int side = sqrt(CACHE_TILE_BYTES / (2 * NO_RGB_PLANES * pixel_bytes));
+      tiling->cols = (width + side - 1) / side;
+      tiling->rows = (height + side - 1) / side;
     } else {
-      return true;
+      // at least one tile, whatever the sectors knob says
+      int sectors = config->sectors > 1 ? config->sectors : 1;
+      if (config->shape == STRIP_TILES) {
+        tiling->cols = 1;
+        tiling->rows = sectors;
+      } else {
+        choose_grid(sectors, width, height, &tiling->cols, &tiling->rows);
+      }
+    }
+    // a tile is at least a pixel
+    tiling->cols = tiling->cols > width ? width : tiling->cols;
+    tiling->rows = tiling->rows > height ? height : tiling->rows;
+
+    // a thread per tile, unless told how many
+    int tiles = tiling->cols * tiling->rows;
+    tiling->workers = config->threads > 0 && config->threads < tiles ? config->threads : tiles;
+  }
+
+  /*
+    Reads the processors of each NUMA node the process may run on, up to 
+    max_nodes of them, returning how many nodes have any (0 if the system
+    does not say).
+  */
+  static int read_nodes(const cpu_set_t *allowed, cpu_set_t *nodes, int max_nodes) {
+    int count = 0;
+    for (int n = 0; count < max_nodes; n++) {
+      char path[64];
+      sprintf(path, "/sys/devices/system/node/node%d/cpulist", n);
+      FILE *f = fopen(path, "r");
+      if (f == NULL) {
+        return count;
+      }
+      // a list of ranges, such as 0-7,16-23
+      CPU_ZERO(&nodes[count]);
+      int first, last;
+      while (fscanf(f, "%d", &first) == 1) {
+        last = first;
+        if (fgetc(f) == '-') {
+          fscanf(f, "%d", &last);
+          fgetc(f);
+        }
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+          if (CPU_ISSET(cpu, allowed)) {
+            CPU_SET(cpu, &nodes[count]);
+          }
+        }
+      }
+      fclose(f);
+      if (CPU_COUNT(&nodes[count]) > 0) {
+        count++;
+      }
     }
+    return count;
   }
 
+  /*
+    Spreads the workers over the processors (or NUMA nodes) the process may
+    run on, round robin.
+  */
+  static void plan_pinning(enum pinning pin, struct tile_worker *workers, int count) {
+    cpu_set_t allowed;
+    if (pin == NO_PINNING || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+      for (int w = 0; w < count; w++) {
+        workers[w].pinned = false;
+      }
+      return;
+    }
+    cpu_set_t nodes[CPU_SETSIZE];
+    int no_nodes = pin == NODE_PINNING ? read_nodes(&allowed, nodes, CPU_SETSIZE) : 0;
+    int cpus[CPU_SETSIZE];
+    int no_cpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        cpus[no_cpus++] = cpu;
+      }
+    }
+    for (int w = 0; w < count; w++) {
+      workers[w].pinned = true;
+      if (no_nodes > 0) {
+        workers[w].cpus = nodes[w % no_nodes];
+      } else {
+        // without NUMA information, pin to cores
+        CPU_ZERO(&workers[w].cpus);
+        CPU_SET(cpus[w % no_cpus], &workers[w].cpus);
+      }
+    }
+  }
 
-  int main(int argc, char **argv){
+  /*
+    Pins the thread if asked to, then blurs every tile of the worker.
+  */
+  static void *blur_tiles(void *worker_ptr) {
+    struct tile_worker *worker = (struct tile_worker *) worker_ptr;
+    const struct tiling *tiling = worker->tiling;
+    if (worker->pinned && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &worker->cpus) != 0) {
+      printf("[!] could not pin sector thread %d\n", worker->index);
+    }
+    int width = tiling->pic->width - 2;
+    int height = tiling->pic->height - 2;
+    struct task_args args;
+    args.pic = tiling->pic;
+    args.tmp = tiling->tmp;
+    for (int t = worker->index; t < tiling->cols * tiling->rows; t += tiling->workers) {
+      // tile bounds are spread evenly, so tiles differ by a pixel at most
+      int c = t % tiling->cols;
+      int r = t / tiling->cols;
+      args.i_start = 1 + (long) width * c / tiling->cols;
+      args.i_end = (long) width * (c + 1) / tiling->cols;
+      args.j_start = 1 + (long) height * r / tiling->rows;
+      args.j_end = (long) height * (r + 1) / tiling->rows;
+      blur_chunk(&args);
+    }
+    return NULL;
+  }
 
-    struct picture *original = (struct picture *) malloc(sizeof(struct picture));
-    if (original == NULL) {
+  /*
+    Bluring function that does bluring in a sector by sector manner.
+    The picture is cut into tiles of the configured shape: any number of 
+    near square tiles or of strips, or as many cache-sized tiles as it 
+    takes. Each thread blurs one tile (or, with a thread count, every 
+    threads'th tile), optionally pinned to a core or NUMA node.
+  */
+  static void blur_sector_by_sector(struct picture *pic, const struct blur_config *config){
+    struct tiling tiling;
+    make_tiling(pic, config, &tiling);
+    init_picture_from_copy(&tiling.tmp, pic, pic->format);
+    struct tile_worker *workers = (struct tile_worker *) malloc(tiling.workers * sizeof(struct tile_worker));
+    if (workers == NULL) {
       printf("Ran out of memory for malloc!\n");
-      return EXIT_FAILURE;
+      return;
     }
-    init_picture_from_file(original, argv[1]);
-    struct picture *pic = (struct picture *) malloc(sizeof(struct picture));
-    if (pic == NULL) {
-      printf("Ran out of memory for malloc!\n");
-      return EXIT_FAILURE;
+    plan_pinning(config->pin, workers, tiling.workers);
+    for (int w = 0; w < tiling.workers; w++) {
+      workers[w].tiling = &tiling;
+      workers[w].index = w;
+      pthread_create(&workers[w].thread, NULL, blur_tiles, &workers[w]);
+    }
+    for (int w = 0; w < tiling.workers; w++) {
+      pthread_join(workers[w].thread, NULL);
     }
-    pic->width = original->width;
-    pic->height = original->height;
 
-    struct timespec start;
-    struct timespec end;
-    double diff;
-    double sum = 0;
-    bool correctness = true;
-    double average[IMPLEMENTATIONS] = {0, 0, 0, 0, 0, 0};
+    clear_picture(&tiling.tmp);
+    free(workers);
+  }
 
-    int repeats = atoi(argv[3]);
+  /*
+    Compares a blurred picture with the reference blur (produced by the 
+    sequential blur_picture), in memory and without any JPEG round trip, 
+    keeping the worst difference seen so far in diff.
+  */
+  static bool check_correctness(struct picture *pic, struct picture *reference, struct picture_diff *diff) {
+    struct picture_diff this_diff;
+    if (!compare_pictures(pic, reference, &this_diff)) {
+      diff->max_diff = MAX_RGB_VALUE;
+      diff->psnr = 0;
+      return false;
+    }
+    diff->max_diff = this_diff.max_diff > diff->max_diff ? this_diff.max_diff : diff->max_diff;
+    diff->mse = this_diff.mse > diff->mse ? this_diff.mse : diff->mse;
+    diff->psnr = this_diff.psnr < diff->psnr ? this_diff.psnr : diff->psnr;
+    return this_diff.max_diff == 0;
+  }
+
+  /*
+    Timings and correctness of one implementation, run with one config on
+    one picture.
+  */
+  struct result {
+    const struct implementation *impl;
+    struct blur_config config;
+    int width;
+    int height;
+    double *timings;
+    struct bench_stats stats;
+    double *setup_timings;      // Setup part of each timing (NAN if not known)
+    struct bench_stats setup_stats;
+    struct bench_stats compute_stats;   // Of the timings less their setup
+    struct picture_diff diff;   // Worst difference from the reference
+    bool correct;
+    double speedup;             // Sequential median over this median (NAN if unknown)
+    double efficiency;          // Speedup per thread used (NAN if unknown)
+    struct perf_sample counts;  // Mean counts per timed run (NAN if not collected)
+    double pixels_per_s;        // Pixels blurred per second (at the median)
+    double bytes_per_s;         // Least memory traffic per second: each pixel 
+                                // read once and written once
+  };
+
+  /*
+    Runs an implementation warmup times untimed, then repeats times timed,
+    each time on a fresh copy of the original. Every timed result is 
+    checked against the reference outside the timed region; with save, the
+    last one is also written to the implementation's file.
+  */
+  static void run_implementation(const struct implementation *impl, const struct blur_config *config, 
+                                 struct picture *original, struct picture *reference, 
+                                 int warmup, int repeats, bool save, struct result *result) {
+    struct picture pic;
+    result->impl = impl;
+    result->config = *config;
+    result->width = original->width;
+    result->height = original->height;
+    result->timings = (double *) malloc(repeats * sizeof(double));
+    result->setup_timings = (double *) malloc(repeats * sizeof(double));
+    result->diff = (struct picture_diff) { 0, 0, INFINITY };
+    result->correct = true;
+    result->speedup = NAN;
+    result->efficiency = NAN;
+    struct perf_sample counts_before;
+    struct perf_sample counts_after;
+    for (int c = 0; c < NO_PERF_COUNTERS; c++) {
+      result->counts.values[c] = counters_enabled ? 0 : NAN;
+    }
+
+    for (int i = -warmup; i < repeats; i++) {
+      // Copies the image to ensure the bluring occurs on the same one each time
+      init_picture_from_copy(&pic, original, original->format);
+      if (counters_enabled) {
+        read_perf_counters(&counters, &counts_before);
+      }
+      setup_done = NAN;
+      double start = bench_now();
+      impl->run(&pic, config);
+      double end = bench_now();
+      if (counters_enabled) {
+        read_perf_counters(&counters, &counts_after);
+      }
+
+      if (i >= 0) {
+        result->timings[i] = end - start;
+        result->setup_timings[i] = setup_done - start;
+        if (counters_enabled) {
+          add_perf_difference(&result->counts, &counts_before, &counts_after);
+        }
+        result->correct &= check_correctness(&pic, reference, &result->diff);
+        if (save && i == repeats - 1) {
+          save_picture_to_file(&pic, impl->file_name);
+        }
+      }
+      clear_picture(&pic);
+    }
+    compute_stats(result->timings, repeats, &result->stats);
+    compute_stats(result->setup_timings, repeats, &result->setup_stats);
+    double *compute_timings = (double *) malloc(repeats * sizeof(double));
+    for (int i = 0; i < repeats; i++) {
+      compute_timings[i] = result->timings[i] - result->setup_timings[i];
+    }
+    compute_stats(compute_timings, repeats, &result->compute_stats);
+    free(compute_timings);
+
+    int pixel_bytes = NO_RGB_PLANES * (original->format == BYTE_PIXELS ? 1 : sizeof(float));
+    result->pixels_per_s = (double) original->width * original->height / result->stats.median;
+    result->bytes_per_s = 2.0 * pixel_bytes * result->pixels_per_s;
+    for (int c = 0; c < NO_PERF_COUNTERS; c++) {
+      result->counts.values[c] /= repeats;
+    }
+  }
+
+  /*
+    Opens the performance counters, saying which of them are unavailable.
+  */
+  static void enable_counters(void) {
+    counters_enabled = true;
+    if (!open_perf_counters(&counters)) {
+      printf("[!] no performance counters are available (see /proc/sys/kernel/perf_event_paranoid); "
+        "reporting timings only\n");
+      return;
+    }
+    for (int c = 0; c < NO_PERF_COUNTERS; c++) {
+      if (counters.fds[c] < 0) {
+        printf("[!] the %s counter is unavailable\n", perf_counter_name(c));
+      }
+    }
+  }
+
+  /*
+    Measures the memory bandwidth with every processor, for reference.
+  */
+  static void measure_stream(void) {
+    int processors = sysconf(_SC_NPROCESSORS_ONLN);
+    measure_stream_bandwidth(processors, &stream);
+    printf("STREAM bandwidth with %d threads: copy %.2f GB/s, triad %.2f GB/s\n", 
+      processors < 1 ? 1 : processors, stream.copy / 1e9, stream.triad / 1e9);
+  }
+
+  /*
+    Prints a result's throughput, and how much of the copy bandwidth its 
+    memory traffic takes up: close to all of it, an implementation is bound
+    by memory bandwidth, far below it, by computation (or overheads).
+  */
+  static void print_throughput(struct result *result) {
+    printf("    %.2f Mpixels/s, %.3f GB/s (%.1f%% of STREAM copy)\n", result->pixels_per_s / 1e6, 
+      result->bytes_per_s / 1e9, 100 * result->bytes_per_s / stream.copy);
+  }
+
+  /*
+    Prints how a result's median time splits into setup and compute, for 
+    the implementations that say when their setup is done.
+  */
+  static void print_setup(struct result *result) {
+    if (isfinite(result->setup_stats.median)) {
+      printf("    setup %.6f compute %.6f\n", result->setup_stats.median, result->compute_stats.median);
+    }
+  }
+
+  /*
+    Prints the mean counts per run of a result on their own line, with the 
+    instructions per cycle when both are known.
+  */
+  static void print_counts(struct result *result) {
+    if (!counters_enabled) {
+      return;
+    }
+    printf("   ");
+    for (int c = 0; c < NO_PERF_COUNTERS; c++) {
+      if (isfinite(result->counts.values[c])) {
+        printf(" %s %.4g", perf_counter_name(c), result->counts.values[c]);
+      }
+    }
+    double ipc = result->counts.values[INSTRUCTIONS_COUNTER] / result->counts.values[CYCLES_COUNTER];
+    if (isfinite(ipc)) {
+      printf(" ipc %.2f", ipc);
+    }
+    printf("\n");
+  }
+
+  /*
+    Fills in the speedup of a result over the sequential median, and the 
+    efficiency: the speedup per thread used. Sector by sector uses a thread 
+    per sector; the efficiency is unknown when the implementation decides 
+    its own number of threads.
+  */
+  static void compute_speedup(struct result *result, double sequential_median) {
+    result->speedup = sequential_median / result->stats.median;
+    int threads = result->config.threads > 0 ? result->config.threads : result->config.sectors;
+    result->efficiency = threads > 0 ? result->speedup / threads : NAN;
+  }
+
+  static void free_results(struct result *results, int count) {
+    for (int r = 0; r < count; r++) {
+      free(results[r].timings);
+      free(results[r].setup_timings);
+    }
+    free(results);
+  }
+
+  /*
+    Writes a CSV field that may be unknown (left empty).
+  */
+  static void write_csv_number(FILE *f, double value, int decimals) {
+    if (isfinite(value)) {
+      fprintf(f, ",%.*f", decimals, value);
+    } else {
+      fprintf(f, ",");
+    }
+  }
+
+  static void write_csv(FILE *f, const char *image, int warmup, struct result *results, int count) {
+    fprintf(f, "implementation,image,width,height,threads,sectors,batch,pin,warmup,repeats,min,median,p95,max,mean,stddev,"
+      "ci95_low,ci95_high,max_diff,psnr,correct,speedup,efficiency,setup_median,compute_median,"
+      "pixels_per_s,bytes_per_s,stream_copy,stream_triad");
+    for (int c = 0; c < NO_PERF_COUNTERS; c++) {
+      fprintf(f, ",%s", perf_counter_name(c));
+    }
+    fprintf(f, "\n");
+    for (int r = 0; r < count; r++) {
+      struct bench_stats *s = &results[r].stats;
+      fprintf(f, "%s,%s,%d,%d,%d,%d,%d,%s,%d,%d,%.9f,%.9f,%.9f,%.9f,%.9f", 
+        results[r].impl->name, image, results[r].width, results[r].height, 
+        results[r].config.threads, results[r].config.sectors, results[r].config.batch, 
+        pinning_names[results[r].config.pin], warmup, s->samples,
+        s->min, s->median, s->p95, s->max, s->mean);
+      write_csv_number(f, s->stddev, 9);
+      write_csv_number(f, s->ci_low, 9);
+      write_csv_number(f, s->ci_high, 9);
+      fprintf(f, ",%d", results[r].diff.max_diff);
+      write_csv_number(f, results[r].diff.psnr, 2);
+      fprintf(f, ",%s", results[r].correct ? "true" : "false");
+      write_csv_number(f, results[r].speedup, 4);
+      write_csv_number(f, results[r].efficiency, 4);
+      write_csv_number(f, results[r].setup_stats.median, 9);
+      write_csv_number(f, results[r].compute_stats.median, 9);
+      write_csv_number(f, results[r].pixels_per_s, 0);
+      write_csv_number(f, results[r].bytes_per_s, 0);
+      write_csv_number(f, stream.copy, 0);
+      write_csv_number(f, stream.triad, 0);
+      for (int c = 0; c < NO_PERF_COUNTERS; c++) {
+        write_csv_number(f, results[r].counts.values[c], 4);
+      }
+      fprintf(f, "\n");
+    }
+  }
 
-    // Creates a file to store the results of the experiment.
-    FILE *f = fopen(argv[2], "w");
+  static void write_json(FILE *f, const char *image, int warmup, struct result *results, int count) {
+    fprintf(f, "{\n  \"image\": ");
+    write_json_string(f, image);
+    fprintf(f, ",\n  \"warmup\": %d,\n  \"stream\": {\"copy\": ", warmup);
+    write_json_number(f, stream.copy, 0);
+    fprintf(f, ", \"triad\": ");
+    write_json_number(f, stream.triad, 0);
+    fprintf(f, "},\n  \"results\": [\n");
+    for (int r = 0; r < count; r++) {
+      struct bench_stats *s = &results[r].stats;
+      fprintf(f, "    {\"implementation\": ");
+      write_json_string(f, results[r].impl->name);
+      fprintf(f, ", \"width\": %d, \"height\": %d, \"threads\": %d, \"sectors\": %d, \"batch\": %d, \"pin\": \"%s\", "
+        "\"repeats\": %d, \"min\": %.9f, \"median\": %.9f, \"p95\": %.9f, \"max\": %.9f, "
+        "\"mean\": %.9f, \"stddev\": ",
+        results[r].width, results[r].height, results[r].config.threads, results[r].config.sectors, results[r].config.batch,
+        pinning_names[results[r].config.pin],
+        s->samples, s->min, s->median, s->p95, s->max, s->mean);
+      write_json_number(f, s->stddev, 9);
+      fprintf(f, ", \"ci95\": [");
+      write_json_number(f, s->ci_low, 9);
+      fprintf(f, ", ");
+      write_json_number(f, s->ci_high, 9);
+      fprintf(f, "], \"max_diff\": %d, \"psnr\": ", results[r].diff.max_diff);
+      // (identical pictures have an infinite PSNR, written as null)
+      write_json_number(f, results[r].diff.psnr, 2);
+      fprintf(f, ", \"correct\": %s, \"speedup\": ", results[r].correct ? "true" : "false");
+      write_json_number(f, results[r].speedup, 4);
+      fprintf(f, ", \"efficiency\": ");
+      write_json_number(f, results[r].efficiency, 4);
+      fprintf(f, ", \"setup_median\": ");
+      write_json_number(f, results[r].setup_stats.median, 9);
+      fprintf(f, ", \"compute_median\": ");
+      write_json_number(f, results[r].compute_stats.median, 9);
+      fprintf(f, ", \"pixels_per_s\": ");
+      write_json_number(f, results[r].pixels_per_s, 0);
+      fprintf(f, ", \"bytes_per_s\": ");
+      write_json_number(f, results[r].bytes_per_s, 0);
+      fprintf(f, ", \"counters\": {");
+      for (int c = 0; c < NO_PERF_COUNTERS; c++) {
+        fprintf(f, "%s\"%s\": ", c == 0 ? "" : ", ", perf_counter_name(c));
+        write_json_number(f, results[r].counts.values[c], 1);
+      }
+      fprintf(f, "}, \"timings\": [");
+      for (int i = 0; i < s->samples; i++) {
+        fprintf(f, "%s%.9f", i == 0 ? "" : ", ", results[r].timings[i]);
+      }
+      fprintf(f, "]}%s\n", r + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+  }
+
+  /*
+    Writes the results to the results file, which is JSON if its name says 
+    so and CSV otherwise.
+  */
+  static void write_results(const char *results_file, const char *image, int warmup, struct result *results, int count) {
+    FILE *f = fopen(results_file, "w");
     if (f == NULL){
       printf("Error opening file!\n");
-      return EXIT_FAILURE;
-    }
-
-    printf("\nBegining the Blur Experiment: \n");
-    fprintf(f, "\nBegining the Blur Experiment: \n");
-
-    // Loops over the number of implementations 
-    for (int r = 0; r < IMPLEMENTATIONS; r++) {
-      printf("\n%s Implementation: \n\n", implemenation_name[r]);
-      fprintf(f, "\n%s Implementation: \n\n", implemenation_name[r]);
-      for (int i = 0; i < repeats; i++){
-        // Copies the image to ensure the bluring occurs on the same one each time
-        pic->img = copy_image(original->img);
-        // Measure time using CLOCK_REALTIME
-        clock_gettime(CLOCK_REALTIME, &start);
-        // Choose which function to use
-        switch (r){
-          case 5:
-            functions[r] (pic, 4);
-            break;
-
-          case 6:
-            functions[r] (pic, 100);
-            break;
-
-          default:
-            functions[r] (pic);
-            break;
+      exit(IO_ERROR);
+    }
+    const char *extension = strrchr(results_file, '.');
+    if (extension != NULL && !strcmp(extension, ".json")) {
+      write_json(f, image, warmup, results, count);
+    } else {
+      write_csv(f, image, warmup, results, count);
+    }
+    fclose(f);
+  }
+
+  static void print_usage(void) {
+    printf("usage: ./blur_opt_exprmt <image> <results.csv|results.json> <repeats> [--warmup N] [--save] [--counters]\n");
+    printf("                         [--batch K] [--pin none|core|node] [implementation ...]\n");
+    printf("       ./blur_opt_exprmt --sweep <results.csv|results.json> <repeats> [--warmup N] [--counters]\n");
+    printf("                         [--pin none|core|node]\n");
+    printf("                         [--threads LIST] [--sectors LIST] [--batches LIST] [--sizes LIST]\n");
+    printf("                         [implementation ...]\n");
+    printf("       ./blur_opt_exprmt --list\n");
+    printf("LISTs are comma separated, e.g. --threads 1,2,4,8\n");
+  }
+
+  static void print_implementations(void) {
+    for (int r = 0; r < no_of_implementations; r++) {
+      printf("  %-18s %s\n", implementations[r].name, implementations[r].description);
+    }
+  }
+
+  /*
+    Looks up an implementation by its name.
+  */
+  static const struct implementation *find_implementation(const char *name) {
+    for (int r = 0; r < no_of_implementations; r++) {
+      if (!strcmp(name, implementations[r].name)) {
+        return &implementations[r];
+      }
+    }
+    printf("[!] no implementation is called %s; the implementations are:\n", name);
+    print_implementations();
+    exit(IO_ERROR);
+  }
+
+  /*
+    Parses what to pin threads to (--pin none|core|node).
+  */
+  static enum pinning parse_pinning(const char *name) {
+    for (int p = NO_PINNING; p <= NODE_PINNING; p++) {
+      if (!strcmp(name, pinning_names[p])) {
+        return p;
+      }
+    }
+    printf("[!] --pin takes none, core or node, not %s\n", name);
+    exit(IO_ERROR);
+  }
+
+  /*
+    Parses a comma separated list of positive numbers into values (which 
+    holds MAX_SWEEP_VALUES), returning how many there are.
+  */
+  static int parse_list(const char *option, const char *list, int *values) {
+    int count = 0;
+    const char *next = list;
+    while (true) {
+      char *end;
+      long value = strtol(next, &end, 10);
+      if (end == next || value < 1 || count == MAX_SWEEP_VALUES || (*end != ',' && *end != '\0')) {
+        printf("[!] %s takes a comma separated list of positive numbers, not %s\n", option, list);
+        exit(IO_ERROR);
+      }
+      values[count++] = (int) value;
+      if (*end == '\0') {
+        return count;
+      }
+      next = end + 1;
+    }
+  }
+
+  /*
+    The thread counts swept by default: the powers of two up to the number
+    of processors, the number of processors itself, and twice that to see 
+    the effect of oversubscription.
+  */
+  static int default_thread_counts(int *values) {
+    int processors = sysconf(_SC_NPROCESSORS_ONLN);
+    processors = processors < 1 ? 1 : processors;
+    int count = 0;
+    for (int t = 1; t < processors; t *= 2) {
+      values[count++] = t;
+    }
+    values[count++] = processors;
+    values[count++] = 2 * processors;
+    return count;
+  }
+
+  /*
+    Prints the results of one image size as a table of speedups.
+  */
+  static void print_sweep_table(int size, struct result *results, int count) {
+    printf("\n%d x %d:\n", size, size);
+    printf("%-36s %8s %8s %8s %10s %10s %10s\n", "implementation", "threads", "sectors", "batch", "median", "speedup", "efficiency");
+    for (int r = 0; r < count; r++) {
+      printf("%-36s %8d %8d %8d %10.6f %10.2f", results[r].impl->description, results[r].config.threads, 
+        results[r].config.sectors, results[r].config.batch, results[r].stats.median, results[r].speedup);
+      if (isfinite(results[r].efficiency)) {
+        printf(" %10.2f", results[r].efficiency);
+      } else {
+        printf(" %10s", "-");
+      }
+      if (!results[r].correct) {
+        printf("  (incorrect: max diff %d)", results[r].diff.max_diff);
+      }
+      printf("\n");
+      print_throughput(&results[r]);
+      print_setup(&results[r]);
+      print_counts(&results[r]);
+    }
+  }
+
+  /*
+    Sweep mode: runs the selected implementations over a grid of thread 
+    counts, sector counts, batch sizes and synthetic image sizes. Each 
+    implementation sweeps the settings it has knobs for, and every result 
+    is given its speedup and efficiency over the sequential blur of the 
+    same image.
+  */
+  static int run_sweep(int argc, char **argv) {
+    if (argc < 4 || atoi(argv[3]) < 1) {
+      print_usage();
+      exit(IO_ERROR);
+    }
+    const char *results_file = argv[2];
+    int repeats = atoi(argv[3]);
+    int warmup = DEFAULT_WARMUP;
+
+    int threads[MAX_SWEEP_VALUES];
+    int sectors[MAX_SWEEP_VALUES];
+    int batches[MAX_SWEEP_VALUES];
+    int sizes[MAX_SWEEP_VALUES];
+    int no_threads = default_thread_counts(threads);
+    int no_sectors = parse_list("--sectors", DEFAULT_SECTORS, sectors);
+    int no_batches = parse_list("--batches", DEFAULT_BATCHES, batches);
+    int no_sizes = parse_list("--sizes", DEFAULT_SIZES, sizes);
+    enum pinning pin = NO_PINNING;
+
+    const struct implementation **selected = malloc((argc + no_of_implementations) * sizeof(struct implementation *));
+    int count = 0;
+    for (int i = 4; i < argc; i++) {
+      bool has_value = i + 1 < argc;
+      if (!strcmp(argv[i], "--warmup") && has_value) {
+        if ((warmup = atoi(argv[++i])) < 0) {
+          print_usage();
+          exit(IO_ERROR);
+        }
+      } else if (!strcmp(argv[i], "--threads") && has_value) {
+        no_threads = parse_list(argv[i], argv[i + 1], threads);
+        i++;
+      } else if (!strcmp(argv[i], "--sectors") && has_value) {
+        no_sectors = parse_list(argv[i], argv[i + 1], sectors);
+        i++;
+      } else if (!strcmp(argv[i], "--batches") && has_value) {
+        no_batches = parse_list(argv[i], argv[i + 1], batches);
+        i++;
+      } else if (!strcmp(argv[i], "--sizes") && has_value) {
+        no_sizes = parse_list(argv[i], argv[i + 1], sizes);
+        i++;
+      } else if (!strcmp(argv[i], "--counters")) {
+        enable_counters();
+      } else if (!strcmp(argv[i], "--pin") && has_value) {
+        pin = parse_pinning(argv[++i]);
+      } else {
+        selected[count++] = find_implementation(argv[i]);
+      }
+    }
+    if (count == 0) {
+      for (int r = 0; r < no_of_implementations; r++) {
+        selected[count++] = &implementations[r];
+      }
+    }
+    for (int s = 0; s < no_sizes; s++) {
+      if (sizes[s] < 3 || sizes[s] > MAX_SWEEP_SIZE) {
+        printf("[!] sweep image sizes must be between 3 and %d, not %d\n", MAX_SWEEP_SIZE, sizes[s]);
+        exit(IO_ERROR);
+      }
+    }
+
+    // Every size has a sequential baseline, plus a result per combination
+    // of the settings of each selected implementation's knobs.
+    int most_results = 1;
+    for (int r = 0; r < count; r++) {
+      most_results += (selected[r]->knobs & THREADS_KNOB ? no_threads : 1) 
+                      * (selected[r]->knobs & SECTORS_KNOB ? no_sectors : 1) 
+                      * (selected[r]->knobs & BATCH_KNOB ? no_batches : 1);
+    }
+    most_results *= no_sizes;
+    struct result *results = malloc(most_results * sizeof(struct result));
+    int no_results = 0;
+    bool correctness = true;
+
+    measure_stream();
+    printf("\nBegining the Blur Sweep (%d warm-up runs, %d timed runs each): \n", warmup, repeats);
+    for (int s = 0; s < no_sizes; s++) {
+      // Synthetic pictures are stored as bytes, so even the largest fit
+      struct picture original;
+      init_picture_from_random(&original, sizes[s], sizes[s], BYTE_PIXELS);
+      struct picture reference;
+      init_picture_from_copy(&reference, &original, original.format);
+      blur_picture(&reference);
+
+      const struct implementation *sequential = &implementations[0];
+      struct result *first = &results[no_results];
+      run_implementation(sequential, &sequential->defaults, &original, &reference, warmup, repeats, false, &results[no_results++]);
+      double sequential_median = first->stats.median;
+
+      for (int r = 0; r < count; r++) {
+        const struct implementation *impl = selected[r];
+        if (impl == sequential) {
+          continue;
+        }
+        if (impl->sweep_size_limit > 0 && sizes[s] > impl->sweep_size_limit) {
+          printf("(skipping %s above %d x %d)\n", impl->name, impl->sweep_size_limit, impl->sweep_size_limit);
+          continue;
         }
-        clock_gettime(CLOCK_REALTIME, &end);
+        for (int t = 0; t < (impl->knobs & THREADS_KNOB ? no_threads : 1); t++) {
+          for (int c = 0; c < (impl->knobs & SECTORS_KNOB ? no_sectors : 1); c++) {
+            for (int b = 0; b < (impl->knobs & BATCH_KNOB ? no_batches : 1); b++) {
+              struct blur_config config = impl->defaults;
+              config.threads = impl->knobs & THREADS_KNOB ? threads[t] : config.threads;
+              config.sectors = impl->knobs & SECTORS_KNOB ? sectors[c] : config.sectors;
+              config.batch = impl->knobs & BATCH_KNOB ? batches[b] : config.batch;
+              config.pin = pin;
+              run_implementation(impl, &config, &original, &reference, warmup, repeats, false, &results[no_results++]);
+            }
+          }
+        }
+      }
+
+      for (struct result *result = first; result < &results[no_results]; result++) {
+        compute_speedup(result, sequential_median);
+        correctness &= result->correct;
+      }
+      print_sweep_table(sizes[s], first, &results[no_results] - first);
+      clear_picture(&reference);
+      clear_picture(&original);
+    }
+
+    write_results(results_file, "random", warmup, results, no_results);
+    printf(correctness ? "\nAll images were blurred correctly.\n" : "\nNot all images were blurred correctly.\n");
+
+    free_results(results, no_results);
+    free(selected);
+    clear_workers();
+    if (counters_enabled) {
+      close_perf_counters(&counters);
+    }
+    return correctness ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  int main(int argc, char **argv){
+
+    if (argc == 2 && !strcmp(argv[1], "--list")) {
+      print_implementations();
+      return EXIT_SUCCESS;
+    }
+    if (argc > 1 && !strcmp(argv[1], "--sweep")) {
+      return run_sweep(argc, argv);
+    }
+    if (argc < 4 || atoi(argv[3]) < 1) {
+      print_usage();
+      exit(IO_ERROR);
+    }
+
+    const char *image = argv[1];
+    const char *results_file = argv[2];
+    int repeats = atoi(argv[3]);
+    int warmup = DEFAULT_WARMUP;
+    bool save = false;
+    int batch = 0;
+    enum pinning pin = NO_PINNING;
 
-        save_picture_to_file(pic, files_names[r]);
-        // Checks the correctness of the blurred files
-        if (r != 0) {
-          correctness &= check_correctness(files_names[r]);
+    // The remaining arguments are options and the implementations to run 
+    // (all of them if none are named).
+    const struct implementation **selected = malloc((argc + no_of_implementations) * sizeof(struct implementation *));
+    int count = 0;
+    for (int i = 4; i < argc; i++) {
+      if (!strcmp(argv[i], "--warmup")) {
+        if (i + 1 == argc || (warmup = atoi(argv[i + 1])) < 0) {
+          print_usage();
+          exit(IO_ERROR);
         }
-        // Compute the time of the iteration
-        diff = ((double) (end.tv_sec - start.tv_sec)) + ((double) (end.tv_nsec - start.tv_nsec)) / BILLION;
-        fprintf(f, "Time in iteration %d for %s: %lf seconds\n", i, implemenation_name[r], diff);
-        sum += diff;
-        clear_picture(pic);
+        i++;
+      } else if (!strcmp(argv[i], "--save")) {
+        save = true;
+      } else if (!strcmp(argv[i], "--batch")) {
+        if (i + 1 == argc || (batch = atoi(argv[i + 1])) < 1) {
+          print_usage();
+          exit(IO_ERROR);
+        }
+        i++;
+      } else if (!strcmp(argv[i], "--pin")) {
+        if (i + 1 == argc) {
+          print_usage();
+          exit(IO_ERROR);
+        }
+        pin = parse_pinning(argv[++i]);
+      } else if (!strcmp(argv[i], "--counters")) {
+        enable_counters();
+      } else {
+        selected[count++] = find_implementation(argv[i]);
+      }
+    }
+    if (count == 0) {
+      for (int r = 0; r < no_of_implementations; r++) {
+        selected[count++] = &implementations[r];
       }
-      // Computes the average time of all iterations.
-      average[r] = sum / repeats;
-      sum = 0;
-      printf("Average time for %s: %lf seconds\n\n", implemenation_name[r], average[r]);
-      fprintf(f, "Average time for %s: %lf seconds\n\n", implemenation_name[r], average[r]);
     }
 
+    struct picture original;
+    if (!init_picture_from_file(&original, image)) {
+      exit(IO_ERROR);
+    }
 
-    printf("\nResults after %d repeats each: \n\n", repeats);
-    fprintf(f, "\nResults after %d repeats each: \n\n", repeats);
-    
-    for (int r = 0; r < IMPLEMENTATIONS; r++) {
-      printf("Average time for %s: %lf seconds\n", implemenation_name[r], average[r]);
-      fprintf(f, "Average time for %s: %lf seconds\n", implemenation_name[r], average[r]);
+    // Creates the reference blur every implementation is checked against.
+    struct picture reference;
+    init_picture_from_copy(&reference, &original, original.format);
+    blur_picture(&reference);
+
+    measure_stream();
+    printf("\nBegining the Blur Experiment (%d warm-up runs, %d timed runs each): \n\n", warmup, repeats);
+    printf("%-36s %10s %10s %10s %10s %23s\n", "implementation", "min", "median", "p95", "stddev", "95% CI of mean");
+
+    struct result *results = malloc(count * sizeof(struct result));
+    bool correctness = true;
+    double sequential_median = NAN;
+    for (int r = 0; r < count; r++) {
+      struct blur_config config = selected[r]->defaults;
+      if (batch > 0 && selected[r]->knobs & BATCH_KNOB) {
+        config.batch = batch;
+      }
+      config.pin = pin;
+      run_implementation(selected[r], &config, &original, &reference, warmup, repeats, save, &results[r]);
+      struct bench_stats *s = &results[r].stats;
+      printf("%-36s %10.6f %10.6f %10.6f %10.6f  [%9.6f, %9.6f]", selected[r]->description, 
+        s->min, s->median, s->p95, s->stddev, s->ci_low, s->ci_high);
+      if (!results[r].correct) {
+        printf("  (incorrect: max diff %d, PSNR %.2f dB)", results[r].diff.max_diff, results[r].diff.psnr);
+      }
+      printf("\n");
+      print_throughput(&results[r]);
+      print_setup(&results[r]);
+      print_counts(&results[r]);
+      correctness &= results[r].correct;
+      if (selected[r] == &implementations[0]) {
+        sequential_median = s->median;
+      }
     }
 
+    // Speedups are only known when the sequential blur was run too.
+    if (!isnan(sequential_median)) {
+      for (int r = 0; r < count; r++) {
+        compute_speedup(&results[r], sequential_median);
+      }
+    }
+    write_results(results_file, image, warmup, results, count);
 
     if (correctness) {
-      fprintf (f, "\nAll images were blurred correctly.\n");
       printf ("\nAll images were blurred correctly.\n");
     } else {
-      fprintf (f, "\nNot all images were blurred correctly.\n");
       printf ("\nNot all images were blurred correctly.\n");
     }
 
-    free(pic);
-
-    clear_picture(original);
-    free(original);
-
-    fclose(f);
+    free_results(results, count);
+    free(selected);
+    clear_workers();
+    if (counters_enabled) {
+      close_perf_counters(&counters);
+    }
+    clear_picture(&reference);
+    clear_picture(&original);
 
-    return EXIT_SUCCESS;
+    return correctness ? EXIT_SUCCESS : EXIT_FAILURE;
   }
@@ -1,6 +1,8 @@
 #ifndef BLUREXPRMT_H
 #define BLUREXPRMT_H
 
+#include <pthread.h>
+#include <sched.h>
 #include "Utils.h"
 #include "Picture.h"
 #include "PicProcess.h"
@@ -18,10 +20,104 @@
     int j_end;              // The j position on which to end the blurring, inclusive
   };    
 
+  /*
+    Struct shared by the implementations that number the interior pixels 
+    (row by row, from 0) and hand out ranges of those numbers.
+  */
+  struct pixel_job {
+    struct picture *pic;    // The picture that needs to be blurred
+    struct picture *tmp;    // The refrence from which to compute the blurred pixels
+    int inner_width;        // The number of interior pixels in a row
+  };
+
+  /*
+    Compact task descriptor for a single pixel, allocated from a slab: the
+    state every task shares is referenced by pointer instead of copied.
+  */
+  struct pixel_task {
+    const struct pixel_job *job;
+    int i;
+    int j;
+  };
+
+  /*
+    Slab of tasks, used as a stack: the whole job takes one allocation.
+  */
+  typedef struct {
+    struct pixel_task *tasks;
+    int size;               // Number of tasks still on the stack
+  } task_slab_t;
+
+  /*
+    Shapes of the tiles the sector implementations cut the picture into.
+  */
+  enum tile_shape {
+    SQUARE_TILES,   // The given number of tiles, as close to square as it allows
+    STRIP_TILES,    // The given number of full width strips
+    CACHE_TILES     // Tiles small enough for the cache, however many it takes
+  };
+
+  /*
+    What the sector implementations pin their threads to.
+  */
+  enum pinning { NO_PINNING, CORE_PINNING, NODE_PINNING };
+
+  /*
+    Settings an implementation is run with.
+  */
+  struct blur_config {
+    int threads;            // Number of threads (0 if the implementation decides)
+    int sectors;            // Number of sectors (0 if unused)
+    int batch;              // Number of pixels claimed at a time (0 if unused)
+    enum tile_shape shape;  // Shape of the sectors
+    enum pinning pin;
+  };
+
   /*
     Generic function pointer for blur functions.
   */
-  typedef void (*blur_func)();
+  typedef void (*blur_func)(struct picture *pic, const struct blur_config *config);
+
+  /*
+    The settings of an implementation that sweep mode varies (flags).
+  */
+  enum blur_knob { NO_KNOB = 0, THREADS_KNOB = 1, SECTORS_KNOB = 2, BATCH_KNOB = 4 };
+
+  /*
+    A blur implementation taking part in the experiment.
+  */
+  struct implementation {
+    const char *name;             // The name that selects it on the command line
+    const char *description;      // The name it is reported under
+    const char *file_name;        // Where its blurred picture is saved on request
+    blur_func run;
+    struct blur_config defaults;  // Settings used outside sweep mode
+    int knobs;                    // The blur_knobs it has
+    int sweep_size_limit;         // Largest image side it is swept at (0 for any)
+  };
+
+  /*
+    How the interior of a picture is cut into tiles: cols x rows of them, 
+    sizes differing by at most a pixel.
+  */
+  struct tiling {
+    struct picture *pic;    // The picture that needs to be blurred
+    struct picture tmp;     // The refrence from which to compute the blurred pixels
+    int cols;
+    int rows;
+    int workers;            // Worker w blurs tiles w, w + workers, ...
+  };
+
+  /*
+    A thread of a tiling and the processors it may run on.
+  */
+  struct tile_worker {
+    pthread_t thread;
+    const struct tiling *tiling;
+    int index;
+    bool pinned;
+    cpu_set_t cpus;
+  };
 
   /*
     Stack element, with pointer to the given task and the next element on the stack.
@@ -0,0 +1,127 @@
+#include "PerfCounters.h"
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+  static const char *counter_names[NO_PERF_COUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", 
+    "branch_misses", "context_switches", "cpu_migrations"
+  };
+
+  const char *perf_counter_name(enum perf_counter counter){
+    return counter_names[counter];
+  }
+
+#ifdef __linux__
+
+  static void describe_counter(enum perf_counter counter, struct perf_event_attr *attr){
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->type = PERF_TYPE_HARDWARE;
+    switch(counter){
+      case CYCLES_COUNTER:
+        attr->config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+      case INSTRUCTIONS_COUNTER:
+        attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+      case L1D_MISSES_COUNTER:
+        attr->type = PERF_TYPE_HW_CACHE;
+        attr->config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) 
+                       | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+      case LLC_MISSES_COUNTER:
+        attr->config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+      case BRANCH_MISSES_COUNTER:
+        attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+      case CONTEXT_SWITCHES_COUNTER:
+        attr->type = PERF_TYPE_SOFTWARE;
+        attr->config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+        break;
+      default:
+        attr->type = PERF_TYPE_SOFTWARE;
+        attr->config = PERF_COUNT_SW_CPU_MIGRATIONS;
+        break;
+    }
+    // count the threads created later too, and report how long the counter
+    // was actually scheduled so multiplexed counts can be scaled up
+    attr->inherit = 1;
+    attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  }
+
+  static int open_counter(struct perf_event_attr *attr){
+    int fd = syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+    if(fd < 0){
+      // unprivileged users may only be allowed to count user space
+      attr->exclude_kernel = 1;
+      attr->exclude_hv = 1;
+      fd = syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+    }
+    return fd;
+  }
+
+  bool open_perf_counters(struct perf_counters *counters){
+    bool any = false;
+    for(int c = 0; c < NO_PERF_COUNTERS; c++){
+      struct perf_event_attr attr;
+      describe_counter(c, &attr);
+      counters->fds[c] = open_counter(&attr);
+      any |= counters->fds[c] >= 0;
+    }
+    return any;
+  }
+
+  void read_perf_counters(struct perf_counters *counters, struct perf_sample *sample){
+    for(int c = 0; c < NO_PERF_COUNTERS; c++){
+      // value, time enabled, time running
+      unsigned long long data[3];
+      sample->values[c] = NAN;
+      if(counters->fds[c] < 0 || read(counters->fds[c], data, sizeof(data)) != sizeof(data)){
+        continue;
+      }
+      if(data[2] == 0){
+        // never scheduled: nothing was counted
+        sample->values[c] = data[1] == 0 ? 0 : NAN;
+      } else {
+        sample->values[c] = (double) data[0] * data[1] / data[2];
+      }
+    }
+  }
+
+#else
+
+  bool open_perf_counters(struct perf_counters *counters){
+    for(int c = 0; c < NO_PERF_COUNTERS; c++){
+      counters->fds[c] = -1;
+    }
+    return false;
+  }
+
+  void read_perf_counters(struct perf_counters *counters, struct perf_sample *sample){
+    for(int c = 0; c < NO_PERF_COUNTERS; c++){
+      sample->values[c] = NAN;
+    }
+  }
+
+#endif
+
+  void close_perf_counters(struct perf_counters *counters){
+    for(int c = 0; c < NO_PERF_COUNTERS; c++){
+      if(counters->fds[c] >= 0){
+        close(counters->fds[c]);
+        counters->fds[c] = -1;
+      }
+    }
+  }
+
+  void add_perf_difference(struct perf_sample *total, const struct perf_sample *start, const struct perf_sample *end){
+    for(int c = 0; c < NO_PERF_COUNTERS; c++){
+      total->values[c] += end->values[c] - start->values[c];
+    }
+  }
@@ -0,0 +1,48 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdbool.h>
+
+  // Hardware and software performance counters for the experiments, read 
+  // through perf_event_open (Linux only). Counters the kernel, the CPU or 
+  // the permissions (see /proc/sys/kernel/perf_event_paranoid) do not allow
+  // are simply reported as unavailable.
+
+  enum perf_counter {
+    CYCLES_COUNTER,
+    INSTRUCTIONS_COUNTER,
+    L1D_MISSES_COUNTER,
+    LLC_MISSES_COUNTER,
+    BRANCH_MISSES_COUNTER,
+    CONTEXT_SWITCHES_COUNTER,
+    CPU_MIGRATIONS_COUNTER,
+    NO_PERF_COUNTERS
+  };
+
+  // the open counters (-1 for those that are unavailable)
+  struct perf_counters {
+    int fds[NO_PERF_COUNTERS];
+  };
+
+  // counts read from the counters, or their difference between two reads;
+  // NAN for unavailable counters
+  struct perf_sample {
+    double values[NO_PERF_COUNTERS];
+  };
+
+  // open the counters for the calling thread and every thread it creates
+  // from then on (so open them before starting any worker threads); 
+  // returns whether any counter is available
+  bool open_perf_counters(struct perf_counters *counters);
+  void close_perf_counters(struct perf_counters *counters);
+
+  // read the current counts (scaled up if the kernel had to multiplex them)
+  void read_perf_counters(struct perf_counters *counters, struct perf_sample *sample);
+
+  // total += end - start, counter by counter
+  void add_perf_difference(struct perf_sample *total, const struct perf_sample *start, const struct perf_sample *end);
+
+  // short name of a counter (for reporting), e.g. "llc_misses"
+  const char *perf_counter_name(enum perf_counter counter);
+
+#endif
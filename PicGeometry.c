@@ -0,0 +1,73 @@
+#include "PicGeometry.h"
+#include "PicProcess.h"
+
+  struct geometry identity_geometry(void){
+    return (struct geometry) { 1, 0, 0, 1 };
+  }
+
+  struct geometry rotate_geometry(int angle){
+    switch(angle){
+      case 90:
+        // (clockwise) x' = -y, y' = x
+        return (struct geometry) { 0, -1, 1, 0 };
+      case 180:
+        return (struct geometry) { -1, 0, 0, -1 };
+      case 270:
+        return (struct geometry) { 0, 1, -1, 0 };
+      default:
+        printf("[!] rotate is undefined for angle %i (must be 90, 180 or 270)\n", angle);
+        exit(IO_ERROR);
+    }
+  }
+
+  struct geometry flip_geometry(char plane){
+    switch(plane){
+      case 'H':
+        // each row is reversed
+        return (struct geometry) { -1, 0, 0, 1 };
+      case 'V':
+        // the rows are put in reverse order
+        return (struct geometry) { 1, 0, 0, -1 };
+      default:
+        printf("[!] flip is undefined for plane %c\n", plane);
+        exit(IO_ERROR);
+    }
+  }
+
+  struct geometry compose_geometry(struct geometry first, struct geometry then){
+    // matrix product then * first
+    return (struct geometry) {
+      then.xx * first.xx + then.xy * first.yx, then.xx * first.xy + then.xy * first.yy,
+      then.yx * first.xx + then.yy * first.yx, then.yx * first.xy + then.yy * first.yy
+    };
+  }
+
+  bool is_identity_geometry(struct geometry geom){
+    return geom.xx == 1 && geom.yy == 1;
+  }
+
+  bool is_transposing_geometry(struct geometry geom){
+    return geom.xy != 0;
+  }
+
+  void apply_geometry(struct picture *pic, struct geometry geom){
+    if(!is_transposing_geometry(geom)){
+      if(geom.xx == -1 && geom.yy == -1){
+        half_turn_rows(pic, 0, (pic->height + 1) / 2);
+      } else if(geom.xx == -1){
+        flip_rows(pic, 'H', 0, pic->height);
+      } else if(geom.yy == -1){
+        flip_rows(pic, 'V', 0, pic->height / 2);
+      }
+      return;
+    }
+
+    // x' = xy * y, y' = yx * x: a transpose, reading the rows bottom up when
+    // x' runs against y and the columns right to left when y' runs against x.
+    // It goes into a new buffer that replaces the old one once complete.
+    struct picture out;
+    init_picture_from_size_as(&out, pic->height, pic->width, pic->format);
+    transpose_tile(pic, &out, geom.xy == -1, geom.yx == -1, 0, 0, pic->width, pic->height);
+    clear_picture(pic);
+    *pic = out;
+  }
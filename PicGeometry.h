@@ -0,0 +1,35 @@
+#ifndef PICGEOMETRY_H
+#define PICGEOMETRY_H
+
+#include "Picture.h"
+#include "Utils.h"
+
+  // Every sequence of rotations (by multiples of 90 degrees) and flips is one
+  // of the 8 symmetries of a rectangle, so it can be composed into a single
+  // geometry and applied in one pass. A geometry maps (centred) picture 
+  // coordinates to new ones: x' = xx * x + xy * y and y' = yx * x + yy * y,
+  // with each entry -1, 0 or 1 (y grows downwards).
+  struct geometry {
+    int xx, xy;
+    int yx, yy;
+  };
+
+  // the geometries of the transformations (both report invalid arguments 
+  // exactly like rotate_picture and flip_picture)
+  struct geometry identity_geometry(void);
+  struct geometry rotate_geometry(int angle);
+  struct geometry flip_geometry(char plane);
+
+  // the geometry of applying first and then then
+  struct geometry compose_geometry(struct geometry first, struct geometry then);
+  bool is_identity_geometry(struct geometry geom);
+
+  // true if geom swaps the width and height of a picture
+  bool is_transposing_geometry(struct geometry geom);
+
+  // transform pic in a single pass: flips and rotation by 180 degrees are 
+  // done in place, the rest as one (cache-blocked) transpose into a new 
+  // buffer; the identity does nothing
+  void apply_geometry(struct picture *pic, struct geometry geom);
+
+#endif
@@ -0,0 +1,631 @@
+#include "PicKernels.h"
+#include "Utils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS
+#include <immintrin.h>
+#endif
+
+  #define NO_RGB_COMPONENTS 3
+
+  // transposes are done in TRANSPOSE_TILE x TRANSPOSE_TILE tiles, so that the
+  // rows of the source and destination touched by a tile stay in cache, and 
+  // each tile is done in small square blocks (8x8 bytes or 4x4 floats)
+  #define TRANSPOSE_TILE 64
+  #define BYTE_BLOCK 8
+  #define FLOAT_BLOCK 4
+
+  // x / 3 for 0 <= x < 2^15, as the high half of x * DIV3_MAGIC shifted right by one
+  #define DIV3_MAGIC 0xAAAB
+
+// -------------------------- portable versions --------------------------- \\
+
+  static void invert_row_scalar(unsigned char *row, int n){
+    for(int i = 0; i < n; i++){
+      row[i] = MAX_RGB_VALUE - row[i];
+    }
+  }
+
+  static void grayscale_row_scalar(unsigned char *red, unsigned char *green, unsigned char *blue, int n){
+    for(int i = 0; i < n; i++){
+      int avg = (red[i] + green[i] + blue[i]) / NO_RGB_COMPONENTS;
+      red[i] = avg;
+      green[i] = avg;
+      blue[i] = avg;
+    }
+  }
+
+  static void reverse_row_scalar(unsigned char *row, int n){
+    for(int i = 0, j = n - 1; i < j; i++, j--){
+      unsigned char tmp = row[i];
+      row[i] = row[j];
+      row[j] = tmp;
+    }
+  }
+
+  static void reverse_swap_rows_scalar(unsigned char *a, unsigned char *b, int n){
+    for(int i = 0; i < n; i++){
+      unsigned char tmp = a[i];
+      a[i] = b[n - 1 - i];
+      b[n - 1 - i] = tmp;
+    }
+  }
+
+  static void transpose_byte_block_scalar(const unsigned char *src, ptrdiff_t src_stride, unsigned char *dst, ptrdiff_t dst_stride){
+    for(int r = 0; r < BYTE_BLOCK; r++){
+      for(int c = 0; c < BYTE_BLOCK; c++){
+        dst[c * dst_stride + r] = src[r * src_stride + c];
+      }
+    }
+  }
+
+  static void transpose_float_block_scalar(const float *src, ptrdiff_t src_stride, float *dst, ptrdiff_t dst_stride){
+    for(int r = 0; r < FLOAT_BLOCK; r++){
+      for(int c = 0; c < FLOAT_BLOCK; c++){
+        dst[c * dst_stride + r] = src[r * src_stride + c];
+      }
+    }
+  }
+
+  static void multiply_add_bytes_scalar(int *restrict acc, const unsigned char *restrict src, int k, int n){
+    for(int i = 0; i < n; i++){
+      acc[i] += k * src[i];
+    }
+  }
+
+  static void multiply_add_ints_scalar(int *restrict acc, const int *restrict src, int k, int n){
+    for(int i = 0; i < n; i++){
+      acc[i] += k * src[i];
+    }
+  }
+
+  static int diff_row_scalar(const unsigned char *a, const unsigned char *b, int n, unsigned long long *squares){
+    int max_diff = 0;
+    unsigned long long sum = 0;
+    for(int i = 0; i < n; i++){
+      int diff = abs(a[i] - b[i]);
+      max_diff = diff > max_diff ? diff : max_diff;
+      sum += diff * diff;
+    }
+    *squares += sum;
+    return max_diff;
+  }
+
+// ---------------------------- x86 versions ------------------------------ \\
+
+  // Since every value is at most MAX_RGB_VALUE (all ones), inverting is a xor
+  // with all ones. For grayscale the bytes are widened to 16 bits, summed,
+  // divided by 3 with DIV3_MAGIC and packed back; the unpack/pack pairs work
+  // within 128-bit lanes, so the byte order is preserved at every width.
+  // The scalar versions finish off the last (n mod vector width) values.
+  //
+  // The reversals work a vector at a time from both ends towards the middle,
+  // reversing the bytes of each vector (SSE2 has no byte shuffle, so there it
+  // is done as dword, word and byte swaps). For reverse_row, vectors are only
+  // taken while the two ends do not overlap; the scalar version then swaps 
+  // the middle. reverse_swap_rows handles two distinct rows, so the vector 
+  // loop can run along the whole row and the scalar version does the rest.
+  //
+  // The transpose blocks interleave the rows with unpacks of growing width
+  // (bytes, then words, then dwords for an 8x8 byte block), leaving each 
+  // column of the block in a contiguous run. They only need SSE2, so they are
+  // used at every x86 level.
+  //
+  // The row differences take |a - b| as the larger of the two saturating 
+  // subtractions, keep a running maximum of it, and square it by widening to
+  // 16 bits and multiply-adding pairs into 32 bits, which are then added 
+  // into 64-bit totals so they cannot overflow.
+  //
+  // The multiply-adds widen the values to 32 bits and use a 32-bit multiply,
+  // which SSE2 does not have; at that level the portable versions are used.
+
+#ifdef X86_KERNELS
+
+  __attribute__((target("sse2")))
+  static void invert_row_sse2(unsigned char *row, int n){
+    __m128i ones = _mm_set1_epi8(-1);
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+      __m128i v = _mm_loadu_si128((__m128i *) (row + i));
+      _mm_storeu_si128((__m128i *) (row + i), _mm_xor_si128(v, ones));
+    }
+    invert_row_scalar(row + i, n - i);
+  }
+
+  __attribute__((target("sse2")))
+  static void grayscale_row_sse2(unsigned char *red, unsigned char *green, unsigned char *blue, int n){
+    __m128i zero = _mm_setzero_si128();
+    __m128i magic = _mm_set1_epi16((short) DIV3_MAGIC);
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+      __m128i r = _mm_loadu_si128((__m128i *) (red + i));
+      __m128i g = _mm_loadu_si128((__m128i *) (green + i));
+      __m128i b = _mm_loadu_si128((__m128i *) (blue + i));
+      __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero)), _mm_unpacklo_epi8(b, zero));
+      __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero)), _mm_unpackhi_epi8(b, zero));
+      lo = _mm_srli_epi16(_mm_mulhi_epu16(lo, magic), 1);
+      hi = _mm_srli_epi16(_mm_mulhi_epu16(hi, magic), 1);
+      __m128i avg = _mm_packus_epi16(lo, hi);
+      _mm_storeu_si128((__m128i *) (red + i), avg);
+      _mm_storeu_si128((__m128i *) (green + i), avg);
+      _mm_storeu_si128((__m128i *) (blue + i), avg);
+    }
+    grayscale_row_scalar(red + i, green + i, blue + i, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  static void invert_row_avx2(unsigned char *row, int n){
+    __m256i ones = _mm256_set1_epi8(-1);
+    int i = 0;
+    for(; i + 32 <= n; i += 32){
+      __m256i v = _mm256_loadu_si256((__m256i *) (row + i));
+      _mm256_storeu_si256((__m256i *) (row + i), _mm256_xor_si256(v, ones));
+    }
+    invert_row_scalar(row + i, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  static void grayscale_row_avx2(unsigned char *red, unsigned char *green, unsigned char *blue, int n){
+    __m256i zero = _mm256_setzero_si256();
+    __m256i magic = _mm256_set1_epi16((short) DIV3_MAGIC);
+    int i = 0;
+    for(; i + 32 <= n; i += 32){
+      __m256i r = _mm256_loadu_si256((__m256i *) (red + i));
+      __m256i g = _mm256_loadu_si256((__m256i *) (green + i));
+      __m256i b = _mm256_loadu_si256((__m256i *) (blue + i));
+      __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(r, zero), _mm256_unpacklo_epi8(g, zero)), _mm256_unpacklo_epi8(b, zero));
+      __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(r, zero), _mm256_unpackhi_epi8(g, zero)), _mm256_unpackhi_epi8(b, zero));
+      lo = _mm256_srli_epi16(_mm256_mulhi_epu16(lo, magic), 1);
+      hi = _mm256_srli_epi16(_mm256_mulhi_epu16(hi, magic), 1);
+      __m256i avg = _mm256_packus_epi16(lo, hi);
+      _mm256_storeu_si256((__m256i *) (red + i), avg);
+      _mm256_storeu_si256((__m256i *) (green + i), avg);
+      _mm256_storeu_si256((__m256i *) (blue + i), avg);
+    }
+    grayscale_row_scalar(red + i, green + i, blue + i, n - i);
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  static void invert_row_avx512(unsigned char *row, int n){
+    __m512i ones = _mm512_set1_epi8(-1);
+    int i = 0;
+    for(; i + 64 <= n; i += 64){
+      __m512i v = _mm512_loadu_si512((void *) (row + i));
+      _mm512_storeu_si512((void *) (row + i), _mm512_xor_si512(v, ones));
+    }
+    invert_row_scalar(row + i, n - i);
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  static void grayscale_row_avx512(unsigned char *red, unsigned char *green, unsigned char *blue, int n){
+    __m512i zero = _mm512_setzero_si512();
+    __m512i magic = _mm512_set1_epi16((short) DIV3_MAGIC);
+    int i = 0;
+    for(; i + 64 <= n; i += 64){
+      __m512i r = _mm512_loadu_si512((void *) (red + i));
+      __m512i g = _mm512_loadu_si512((void *) (green + i));
+      __m512i b = _mm512_loadu_si512((void *) (blue + i));
+      __m512i lo = _mm512_add_epi16(_mm512_add_epi16(_mm512_unpacklo_epi8(r, zero), _mm512_unpacklo_epi8(g, zero)), _mm512_unpacklo_epi8(b, zero));
+      __m512i hi = _mm512_add_epi16(_mm512_add_epi16(_mm512_unpackhi_epi8(r, zero), _mm512_unpackhi_epi8(g, zero)), _mm512_unpackhi_epi8(b, zero));
+      lo = _mm512_srli_epi16(_mm512_mulhi_epu16(lo, magic), 1);
+      hi = _mm512_srli_epi16(_mm512_mulhi_epu16(hi, magic), 1);
+      __m512i avg = _mm512_packus_epi16(lo, hi);
+      _mm512_storeu_si512((void *) (red + i), avg);
+      _mm512_storeu_si512((void *) (green + i), avg);
+      _mm512_storeu_si512((void *) (blue + i), avg);
+    }
+    grayscale_row_scalar(red + i, green + i, blue + i, n - i);
+  }
+
+  __attribute__((target("sse2")))
+  static inline __m128i reverse_bytes_sse2(__m128i v){
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+  }
+
+  __attribute__((target("sse2")))
+  static void reverse_row_sse2(unsigned char *row, int n){
+    int i = 0;
+    for(; 2 * (i + 16) <= n; i += 16){
+      __m128i left = _mm_loadu_si128((__m128i *) (row + i));
+      __m128i right = _mm_loadu_si128((__m128i *) (row + n - i - 16));
+      _mm_storeu_si128((__m128i *) (row + i), reverse_bytes_sse2(right));
+      _mm_storeu_si128((__m128i *) (row + n - i - 16), reverse_bytes_sse2(left));
+    }
+    reverse_row_scalar(row + i, n - 2 * i);
+  }
+
+  __attribute__((target("sse2")))
+  static void reverse_swap_rows_sse2(unsigned char *a, unsigned char *b, int n){
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+      __m128i from_a = _mm_loadu_si128((__m128i *) (a + i));
+      __m128i from_b = _mm_loadu_si128((__m128i *) (b + n - i - 16));
+      _mm_storeu_si128((__m128i *) (a + i), reverse_bytes_sse2(from_b));
+      _mm_storeu_si128((__m128i *) (b + n - i - 16), reverse_bytes_sse2(from_a));
+    }
+    reverse_swap_rows_scalar(a + i, b, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  static inline __m256i reverse_bytes_avx2(__m256i v){
+    __m256i reverse_lane = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                            15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, reverse_lane), _MM_SHUFFLE(1, 0, 3, 2));
+  }
+
+  __attribute__((target("avx2")))
+  static void reverse_row_avx2(unsigned char *row, int n){
+    int i = 0;
+    for(; 2 * (i + 32) <= n; i += 32){
+      __m256i left = _mm256_loadu_si256((__m256i *) (row + i));
+      __m256i right = _mm256_loadu_si256((__m256i *) (row + n - i - 32));
+      _mm256_storeu_si256((__m256i *) (row + i), reverse_bytes_avx2(right));
+      _mm256_storeu_si256((__m256i *) (row + n - i - 32), reverse_bytes_avx2(left));
+    }
+    reverse_row_scalar(row + i, n - 2 * i);
+  }
+
+  __attribute__((target("avx2")))
+  static void reverse_swap_rows_avx2(unsigned char *a, unsigned char *b, int n){
+    int i = 0;
+    for(; i + 32 <= n; i += 32){
+      __m256i from_a = _mm256_loadu_si256((__m256i *) (a + i));
+      __m256i from_b = _mm256_loadu_si256((__m256i *) (b + n - i - 32));
+      _mm256_storeu_si256((__m256i *) (a + i), reverse_bytes_avx2(from_b));
+      _mm256_storeu_si256((__m256i *) (b + n - i - 32), reverse_bytes_avx2(from_a));
+    }
+    reverse_swap_rows_scalar(a + i, b, n - i);
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  static inline __m512i reverse_bytes_avx512(__m512i v){
+    __m512i reverse_lane = _mm512_broadcast_i32x4(_mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    v = _mm512_shuffle_epi8(v, reverse_lane);
+    return _mm512_shuffle_i64x2(v, v, _MM_SHUFFLE(0, 1, 2, 3));
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  static void reverse_row_avx512(unsigned char *row, int n){
+    int i = 0;
+    for(; 2 * (i + 64) <= n; i += 64){
+      __m512i left = _mm512_loadu_si512((void *) (row + i));
+      __m512i right = _mm512_loadu_si512((void *) (row + n - i - 64));
+      _mm512_storeu_si512((void *) (row + i), reverse_bytes_avx512(right));
+      _mm512_storeu_si512((void *) (row + n - i - 64), reverse_bytes_avx512(left));
+    }
+    reverse_row_scalar(row + i, n - 2 * i);
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  static void reverse_swap_rows_avx512(unsigned char *a, unsigned char *b, int n){
+    int i = 0;
+    for(; i + 64 <= n; i += 64){
+      __m512i from_a = _mm512_loadu_si512((void *) (a + i));
+      __m512i from_b = _mm512_loadu_si512((void *) (b + n - i - 64));
+      _mm512_storeu_si512((void *) (a + i), reverse_bytes_avx512(from_b));
+      _mm512_storeu_si512((void *) (b + n - i - 64), reverse_bytes_avx512(from_a));
+    }
+    reverse_swap_rows_scalar(a + i, b, n - i);
+  }
+
+  __attribute__((target("sse2")))
+  static void transpose_byte_block_sse2(const unsigned char *src, ptrdiff_t src_stride, unsigned char *dst, ptrdiff_t dst_stride){
+    __m128i rows[BYTE_BLOCK];
+    for(int r = 0; r < BYTE_BLOCK; r++){
+      rows[r] = _mm_loadl_epi64((__m128i *) (src + r * src_stride));
+    }
+    __m128i t0 = _mm_unpacklo_epi8(rows[0], rows[1]);
+    __m128i t1 = _mm_unpacklo_epi8(rows[2], rows[3]);
+    __m128i t2 = _mm_unpacklo_epi8(rows[4], rows[5]);
+    __m128i t3 = _mm_unpacklo_epi8(rows[6], rows[7]);
+    __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+    __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+    __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+    __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+    // each of these holds two columns of the block
+    __m128i columns[4] = {
+      _mm_unpacklo_epi32(u0, u2), _mm_unpackhi_epi32(u0, u2),
+      _mm_unpacklo_epi32(u1, u3), _mm_unpackhi_epi32(u1, u3)
+    };
+    for(int c = 0; c < 4; c++){
+      _mm_storel_epi64((__m128i *) (dst + (2 * c) * dst_stride), columns[c]);
+      _mm_storel_epi64((__m128i *) (dst + (2 * c + 1) * dst_stride), _mm_unpackhi_epi64(columns[c], columns[c]));
+    }
+  }
+
+  __attribute__((target("sse2")))
+  static void transpose_float_block_sse2(const float *src, ptrdiff_t src_stride, float *dst, ptrdiff_t dst_stride){
+    __m128 r0 = _mm_loadu_ps(src);
+    __m128 r1 = _mm_loadu_ps(src + src_stride);
+    __m128 r2 = _mm_loadu_ps(src + 2 * src_stride);
+    __m128 r3 = _mm_loadu_ps(src + 3 * src_stride);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(dst, r0);
+    _mm_storeu_ps(dst + dst_stride, r1);
+    _mm_storeu_ps(dst + 2 * dst_stride, r2);
+    _mm_storeu_ps(dst + 3 * dst_stride, r3);
+  }
+
+  __attribute__((target("sse2")))
+  static int diff_row_sse2(const unsigned char *a, const unsigned char *b, int n, unsigned long long *squares){
+    __m128i zero = _mm_setzero_si128();
+    __m128i max = zero;
+    __m128i sum = zero;
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+      __m128i x = _mm_loadu_si128((__m128i *) (a + i));
+      __m128i y = _mm_loadu_si128((__m128i *) (b + i));
+      __m128i diff = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+      max = _mm_max_epu8(max, diff);
+      __m128i lo = _mm_unpacklo_epi8(diff, zero);
+      __m128i hi = _mm_unpackhi_epi8(diff, zero);
+      __m128i pairs = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+      sum = _mm_add_epi64(sum, _mm_add_epi64(_mm_unpacklo_epi32(pairs, zero), _mm_unpackhi_epi32(pairs, zero)));
+    }
+    unsigned char maxes[16];
+    unsigned long long sums[2];
+    _mm_storeu_si128((__m128i *) maxes, max);
+    _mm_storeu_si128((__m128i *) sums, sum);
+    int max_diff = diff_row_scalar(a + i, b + i, n - i, squares);
+    for(int k = 0; k < 16; k++){
+      max_diff = maxes[k] > max_diff ? maxes[k] : max_diff;
+    }
+    *squares += sums[0] + sums[1];
+    return max_diff;
+  }
+
+  __attribute__((target("avx2")))
+  static int diff_row_avx2(const unsigned char *a, const unsigned char *b, int n, unsigned long long *squares){
+    __m256i zero = _mm256_setzero_si256();
+    __m256i max = zero;
+    __m256i sum = zero;
+    int i = 0;
+    for(; i + 32 <= n; i += 32){
+      __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+      __m256i y = _mm256_loadu_si256((__m256i *) (b + i));
+      __m256i diff = _mm256_or_si256(_mm256_subs_epu8(x, y), _mm256_subs_epu8(y, x));
+      max = _mm256_max_epu8(max, diff);
+      __m256i lo = _mm256_unpacklo_epi8(diff, zero);
+      __m256i hi = _mm256_unpackhi_epi8(diff, zero);
+      __m256i pairs = _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi));
+      sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_unpacklo_epi32(pairs, zero), _mm256_unpackhi_epi32(pairs, zero)));
+    }
+    unsigned char maxes[32];
+    unsigned long long sums[4];
+    _mm256_storeu_si256((__m256i *) maxes, max);
+    _mm256_storeu_si256((__m256i *) sums, sum);
+    int max_diff = diff_row_scalar(a + i, b + i, n - i, squares);
+    for(int k = 0; k < 32; k++){
+      max_diff = maxes[k] > max_diff ? maxes[k] : max_diff;
+    }
+    *squares += sums[0] + sums[1] + sums[2] + sums[3];
+    return max_diff;
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  static int diff_row_avx512(const unsigned char *a, const unsigned char *b, int n, unsigned long long *squares){
+    __m512i zero = _mm512_setzero_si512();
+    __m512i max = zero;
+    __m512i sum = zero;
+    int i = 0;
+    for(; i + 64 <= n; i += 64){
+      __m512i x = _mm512_loadu_si512((void *) (a + i));
+      __m512i y = _mm512_loadu_si512((void *) (b + i));
+      __m512i diff = _mm512_or_si512(_mm512_subs_epu8(x, y), _mm512_subs_epu8(y, x));
+      max = _mm512_max_epu8(max, diff);
+      __m512i lo = _mm512_unpacklo_epi8(diff, zero);
+      __m512i hi = _mm512_unpackhi_epi8(diff, zero);
+      __m512i pairs = _mm512_add_epi32(_mm512_madd_epi16(lo, lo), _mm512_madd_epi16(hi, hi));
+      sum = _mm512_add_epi64(sum, _mm512_add_epi64(_mm512_unpacklo_epi32(pairs, zero), _mm512_unpackhi_epi32(pairs, zero)));
+    }
+    unsigned char maxes[64];
+    unsigned long long sums[8];
+    _mm512_storeu_si512((void *) maxes, max);
+    _mm512_storeu_si512((void *) sums, sum);
+    int max_diff = diff_row_scalar(a + i, b + i, n - i, squares);
+    for(int k = 0; k < 64; k++){
+      max_diff = maxes[k] > max_diff ? maxes[k] : max_diff;
+    }
+    for(int k = 0; k < 8; k++){
+      *squares += sums[k];
+    }
+    return max_diff;
+  }
+
+  __attribute__((target("avx2")))
+  static void multiply_add_bytes_avx2(int *restrict acc, const unsigned char *restrict src, int k, int n){
+    __m256i factor = _mm256_set1_epi32(k);
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+      __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *) (src + i)));
+      __m256i sum = _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (acc + i)), _mm256_mullo_epi32(v, factor));
+      _mm256_storeu_si256((__m256i *) (acc + i), sum);
+    }
+    multiply_add_bytes_scalar(acc + i, src + i, k, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  static void multiply_add_ints_avx2(int *restrict acc, const int *restrict src, int k, int n){
+    __m256i factor = _mm256_set1_epi32(k);
+    int i = 0;
+    for(; i + 8 <= n; i += 8){
+      __m256i v = _mm256_loadu_si256((__m256i *) (src + i));
+      __m256i sum = _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (acc + i)), _mm256_mullo_epi32(v, factor));
+      _mm256_storeu_si256((__m256i *) (acc + i), sum);
+    }
+    multiply_add_ints_scalar(acc + i, src + i, k, n - i);
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  static void multiply_add_bytes_avx512(int *restrict acc, const unsigned char *restrict src, int k, int n){
+    __m512i factor = _mm512_set1_epi32(k);
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+      __m512i v = _mm512_cvtepu8_epi32(_mm_loadu_si128((__m128i *) (src + i)));
+      __m512i sum = _mm512_add_epi32(_mm512_loadu_si512((void *) (acc + i)), _mm512_mullo_epi32(v, factor));
+      _mm512_storeu_si512((void *) (acc + i), sum);
+    }
+    multiply_add_bytes_scalar(acc + i, src + i, k, n - i);
+  }
+
+  __attribute__((target("avx512f,avx512bw")))
+  static void multiply_add_ints_avx512(int *restrict acc, const int *restrict src, int k, int n){
+    __m512i factor = _mm512_set1_epi32(k);
+    int i = 0;
+    for(; i + 16 <= n; i += 16){
+      __m512i v = _mm512_loadu_si512((void *) (src + i));
+      __m512i sum = _mm512_add_epi32(_mm512_loadu_si512((void *) (acc + i)), _mm512_mullo_epi32(v, factor));
+      _mm512_storeu_si512((void *) (acc + i), sum);
+    }
+    multiply_add_ints_scalar(acc + i, src + i, k, n - i);
+  }
+
+#endif
+
+// ----------------------------- dispatch --------------------------------- \\
+
+  static void (*invert_row_impl)(unsigned char *, int) = invert_row_scalar;
+  static void (*grayscale_row_impl)(unsigned char *, unsigned char *, unsigned char *, int) = grayscale_row_scalar;
+  static void (*reverse_row_impl)(unsigned char *, int) = reverse_row_scalar;
+  static void (*reverse_swap_rows_impl)(unsigned char *, unsigned char *, int) = reverse_swap_rows_scalar;
+  static void (*transpose_byte_block_impl)(const unsigned char *, ptrdiff_t, unsigned char *, ptrdiff_t) = transpose_byte_block_scalar;
+  static void (*transpose_float_block_impl)(const float *, ptrdiff_t, float *, ptrdiff_t) = transpose_float_block_scalar;
+  static void (*multiply_add_bytes_impl)(int *, const unsigned char *, int, int) = multiply_add_bytes_scalar;
+  static void (*multiply_add_ints_impl)(int *, const int *, int, int) = multiply_add_ints_scalar;
+  static int (*diff_row_impl)(const unsigned char *, const unsigned char *, int, unsigned long long *) = diff_row_scalar;
+  static const char *isa_name = "scalar";
+
+  // pick the widest kernels the CPU supports before main runs
+  __attribute__((constructor))
+  static void select_kernels(void){
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("sse2")){
+      transpose_byte_block_impl = transpose_byte_block_sse2;
+      transpose_float_block_impl = transpose_float_block_sse2;
+    }
+    if(__builtin_cpu_supports("avx512bw")){
+      invert_row_impl = invert_row_avx512;
+      grayscale_row_impl = grayscale_row_avx512;
+      reverse_row_impl = reverse_row_avx512;
+      reverse_swap_rows_impl = reverse_swap_rows_avx512;
+      multiply_add_bytes_impl = multiply_add_bytes_avx512;
+      multiply_add_ints_impl = multiply_add_ints_avx512;
+      diff_row_impl = diff_row_avx512;
+      isa_name = "avx512";
+    } else if(__builtin_cpu_supports("avx2")){
+      invert_row_impl = invert_row_avx2;
+      grayscale_row_impl = grayscale_row_avx2;
+      reverse_row_impl = reverse_row_avx2;
+      reverse_swap_rows_impl = reverse_swap_rows_avx2;
+      multiply_add_bytes_impl = multiply_add_bytes_avx2;
+      multiply_add_ints_impl = multiply_add_ints_avx2;
+      diff_row_impl = diff_row_avx2;
+      isa_name = "avx2";
+    } else if(__builtin_cpu_supports("sse2")){
+      invert_row_impl = invert_row_sse2;
+      grayscale_row_impl = grayscale_row_sse2;
+      reverse_row_impl = reverse_row_sse2;
+      reverse_swap_rows_impl = reverse_swap_rows_sse2;
+      diff_row_impl = diff_row_sse2;
+      isa_name = "sse2";
+    }
+#endif
+  }
+
+  void invert_row(unsigned char *row, int n){
+    invert_row_impl(row, n);
+  }
+
+  void grayscale_row(unsigned char *red, unsigned char *green, unsigned char *blue, int n){
+    grayscale_row_impl(red, green, blue, n);
+  }
+
+  void reverse_row(unsigned char *row, int n){
+    reverse_row_impl(row, n);
+  }
+
+  void reverse_swap_rows(unsigned char *a, unsigned char *b, int n){
+    reverse_swap_rows_impl(a, b, n);
+  }
+
+  void multiply_add_bytes(int *acc, const unsigned char *src, int k, int n){
+    multiply_add_bytes_impl(acc, src, k, n);
+  }
+
+  void multiply_add_ints(int *acc, const int *src, int k, int n){
+    multiply_add_ints_impl(acc, src, k, n);
+  }
+
+  int diff_row(const unsigned char *a, const unsigned char *b, int n, unsigned long long *squares){
+    return diff_row_impl(a, b, n, squares);
+  }
+
+  // Transpose one tile: whole blocks go through the block kernel, and the
+  // ragged right and bottom edges are copied one value at a time.
+  static void transpose_byte_tile(const unsigned char *src, ptrdiff_t src_stride, unsigned char *dst, ptrdiff_t dst_stride, int rows, int cols){
+    int r = 0;
+    for(; r + BYTE_BLOCK <= rows; r += BYTE_BLOCK){
+      int c = 0;
+      for(; c + BYTE_BLOCK <= cols; c += BYTE_BLOCK){
+        transpose_byte_block_impl(src + r * src_stride + c, src_stride, dst + c * dst_stride + r, dst_stride);
+      }
+      for(int k = r; k < r + BYTE_BLOCK; k++){
+        for(int e = c; e < cols; e++){
+          dst[e * dst_stride + k] = src[k * src_stride + e];
+        }
+      }
+    }
+    for(; r < rows; r++){
+      for(int c = 0; c < cols; c++){
+        dst[c * dst_stride + r] = src[r * src_stride + c];
+      }
+    }
+  }
+
+  static void transpose_float_tile(const float *src, ptrdiff_t src_stride, float *dst, ptrdiff_t dst_stride, int rows, int cols){
+    int r = 0;
+    for(; r + FLOAT_BLOCK <= rows; r += FLOAT_BLOCK){
+      int c = 0;
+      for(; c + FLOAT_BLOCK <= cols; c += FLOAT_BLOCK){
+        transpose_float_block_impl(src + r * src_stride + c, src_stride, dst + c * dst_stride + r, dst_stride);
+      }
+      for(int k = r; k < r + FLOAT_BLOCK; k++){
+        for(int e = c; e < cols; e++){
+          dst[e * dst_stride + k] = src[k * src_stride + e];
+        }
+      }
+    }
+    for(; r < rows; r++){
+      for(int c = 0; c < cols; c++){
+        dst[c * dst_stride + r] = src[r * src_stride + c];
+      }
+    }
+  }
+
+  void transpose_bytes(const unsigned char *src, ptrdiff_t src_stride, unsigned char *dst, ptrdiff_t dst_stride, int rows, int cols){
+    for(int r = 0; r < rows; r += TRANSPOSE_TILE){
+      for(int c = 0; c < cols; c += TRANSPOSE_TILE){
+        int tile_rows = rows - r < TRANSPOSE_TILE ? rows - r : TRANSPOSE_TILE;
+        int tile_cols = cols - c < TRANSPOSE_TILE ? cols - c : TRANSPOSE_TILE;
+        transpose_byte_tile(src + r * src_stride + c, src_stride, dst + c * dst_stride + r, dst_stride, tile_rows, tile_cols);
+      }
+    }
+  }
+
+  void transpose_floats(const float *src, ptrdiff_t src_stride, float *dst, ptrdiff_t dst_stride, int rows, int cols){
+    for(int r = 0; r < rows; r += TRANSPOSE_TILE){
+      for(int c = 0; c < cols; c += TRANSPOSE_TILE){
+        int tile_rows = rows - r < TRANSPOSE_TILE ? rows - r : TRANSPOSE_TILE;
+        int tile_cols = cols - c < TRANSPOSE_TILE ? cols - c : TRANSPOSE_TILE;
+        transpose_float_tile(src + r * src_stride + c, src_stride, dst + c * dst_stride + r, dst_stride, tile_rows, tile_cols);
+      }
+    }
+  }
+
+  const char *kernel_isa_name(void){
+    return isa_name;
+  }
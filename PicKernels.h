@@ -0,0 +1,43 @@
+#ifndef PICKERNELS_H
+#define PICKERNELS_H
+
+#include <stddef.h>
+
+  // Row kernels used by the picture transformation routines. Each kernel has
+  // a portable scalar version and, on x86, SSE2/AVX2/AVX-512 versions; the
+  // widest one the CPU supports is picked (via cpuid) when the program starts.
+  // Every version produces exactly the same values as the scalar one.
+
+  // replace each of the n values in row with MAX_RGB_VALUE - value
+  void invert_row(unsigned char *row, int n);
+
+  // replace the n values in each of the three colour rows with the (truncated)
+  // average of the red, green and blue values at that position
+  void grayscale_row(unsigned char *red, unsigned char *green, unsigned char *blue, int n);
+
+  // reverse the order of the n values in row, in place
+  void reverse_row(unsigned char *row, int n);
+
+  // replace rows a and b (distinct, n values each) with the reverse of the other
+  void reverse_swap_rows(unsigned char *a, unsigned char *b, int n);
+
+  // acc[i] += k * src[i] for the n values of src (the building block of the
+  // convolutions); the sums must fit in an int
+  void multiply_add_bytes(int *acc, const unsigned char *src, int k, int n);
+  void multiply_add_ints(int *acc, const int *src, int k, int n);
+
+  // the largest absolute difference between the n values of rows a and b;
+  // the sum of their squared differences is added to *squares
+  int diff_row(const unsigned char *a, const unsigned char *b, int n, unsigned long long *squares);
+
+  // Transpose a rows x cols block of values: dst[c * dst_stride + r] becomes
+  // src[r * src_stride + c]. Strides may be negative, which turns the 
+  // transpose into a rotation (e.g. starting src at its last row with a 
+  // negative stride reads it bottom up). Done in cache-sized tiles.
+  void transpose_bytes(const unsigned char *src, ptrdiff_t src_stride, unsigned char *dst, ptrdiff_t dst_stride, int rows, int cols);
+  void transpose_floats(const float *src, ptrdiff_t src_stride, float *dst, ptrdiff_t dst_stride, int rows, int cols);
+
+  // name of the instruction set the kernels were chosen for (for reporting)
+  const char *kernel_isa_name(void);
+
+#endif
@@ -0,0 +1,301 @@
+#include "PicParallel.h"
+#include "PicProcess.h"
+#include "WorkStealing.h"
+#include "thpool/thpool.h"
+
+  // pointwise and row-swapping work is cut into this many row bands per 
+  // worker, so that a slow band does not hold up the whole picture
+  #define BANDS_PER_WORKER 4
+
+  // side of the tiles the transposing geometries are cut into
+  #define TRANSPOSE_TILE_SIZE 256
+
+  // flags packed into the arg of a transpose task
+  #define ROWS_BOTTOM_UP 1
+  #define COLS_RIGHT_TO_LEFT 2
+
+  static threadpool workers = NULL;
+  static struct stealing_pool *stealers = NULL;
+  static int worker_count = 1;
+
+  // one band or tile of work: run is called on the worker with the task
+  struct tile_task {
+    void (*run)(struct tile_task *);
+    struct picture *pic;
+    struct picture *other;  // rotated picture, or the blur source snapshot
+    int arg;                // plane, transpose flags, number of blurs or of ops
+    const void *data;       // pointwise ops or convolution
+    int x0, y0, x1, y1;
+  };
+
+  void init_workers(int threads){
+    init_workers_of(POOL_WORKERS, threads);
+  }
+
+  void init_workers_of(enum worker_kind kind, int threads){
+    clear_workers();
+    if(threads > 1){
+      if(kind == STEALING_WORKERS){
+        stealers = stealing_pool_init(threads);
+      } else {
+        // the caller takes chunks in thpool_parallel_for as well
+        workers = thpool_init(threads - 1);
+      }
+      if(workers == NULL && stealers == NULL){
+        printf("[!] could not start %i worker threads\n", threads);
+        exit(IO_ERROR);
+      }
+      worker_count = threads;
+    }
+  }
+
+  void clear_workers(void){
+    if(workers != NULL){
+      thpool_destroy(workers);
+      workers = NULL;
+    }
+    if(stealers != NULL){
+      stealing_pool_destroy(stealers);
+      stealers = NULL;
+    }
+    worker_count = 1;
+  }
+
+  int get_worker_count(void){
+    return worker_count;
+  }
+
+  enum worker_kind get_worker_kind(void){
+    return stealers != NULL ? STEALING_WORKERS : POOL_WORKERS;
+  }
+
+// ------------------------- task distribution ------------------------- \\
+
+  static void run_task_range(void *ctx, int first, int last){
+    struct tile_task *tasks = ctx;
+    for(int i = first; i < last; i++){
+      tasks[i].run(&tasks[i]);
+    }
+  }
+
+  // the pool and this thread share the tasks out one at a time, and only 
+  // these tasks are waited for
+  static void run_tasks(struct tile_task *tasks, int count){
+    thpool_parallel_for(workers, 0, count, 1, run_task_range, tasks);
+  }
+
+  // with stealing workers, a band task is cut into bands of rows
+  static void run_band_range(void *ctx, int y0, int y1){
+    struct tile_task task = *(struct tile_task *) ctx;
+    task.y0 = y0;
+    task.y1 = y1;
+    task.run(&task);
+  }
+
+  // and a tile task into runs of tiles, numbered across then down
+  struct tile_grid {
+    struct tile_task task;
+    int across;
+    int tile;
+  };
+
+  static void run_tile_range(void *ctx, int first, int last){
+    struct tile_grid *grid = ctx;
+    struct tile_task task = grid->task;
+    for(int t = first; t < last; t++){
+      task.x0 = t % grid->across * grid->tile;
+      task.y0 = t / grid->across * grid->tile;
+      task.x1 = task.x0 + grid->tile < task.pic->width ? task.x0 + grid->tile : task.pic->width;
+      task.y1 = task.y0 + grid->tile < task.pic->height ? task.y0 + grid->tile : task.pic->height;
+      task.run(&task);
+    }
+  }
+
+  // cut rows [0, rows) into even bands across the full width of pic
+  static void run_bands(void (*run)(struct tile_task *), struct picture *pic, struct picture *other, int arg, const void *data, int rows){
+    if(stealers != NULL){
+      // the scheduler sizes the bands itself
+      struct tile_task task = {
+        .run = run, .pic = pic, .other = other, .arg = arg, .data = data, .x0 = 0, .x1 = pic->width
+      };
+      stealing_parallel_for(stealers, 0, rows, 0, run_band_range, &task);
+      return;
+    }
+    int bands = worker_count * BANDS_PER_WORKER;
+    if(bands > rows){
+      bands = rows;
+    }
+    if(bands < 1){
+      return;
+    }
+    struct tile_task *tasks = malloc(bands * sizeof(struct tile_task));
+    for(int b = 0; b < bands; b++){
+      tasks[b] = (struct tile_task) {
+        .run = run, .pic = pic, .other = other, .arg = arg, .data = data,
+        .x0 = 0, .y0 = (long) rows * b / bands, .x1 = pic->width, .y1 = (long) rows * (b + 1) / bands
+      };
+    }
+    run_tasks(tasks, bands);
+    free(tasks);
+  }
+
+  // cut the whole of pic into tile x tile squares (smaller at the edges)
+  static void run_tiles(void (*run)(struct tile_task *), struct picture *pic, struct picture *other, int arg, int tile){
+    int across = (pic->width + tile - 1) / tile;
+    int down = (pic->height + tile - 1) / tile;
+    if(stealers != NULL){
+      struct tile_grid grid = {
+        .task = { .run = run, .pic = pic, .other = other, .arg = arg },
+        .across = across, .tile = tile
+      };
+      stealing_parallel_for(stealers, 0, across * down, 1, run_tile_range, &grid);
+      return;
+    }
+    struct tile_task *tasks = malloc(across * down * sizeof(struct tile_task));
+    int count = 0;
+    for(int y0 = 0; y0 < pic->height; y0 += tile){
+      for(int x0 = 0; x0 < pic->width; x0 += tile){
+        int x1 = x0 + tile < pic->width ? x0 + tile : pic->width;
+        int y1 = y0 + tile < pic->height ? y0 + tile : pic->height;
+        tasks[count++] = (struct tile_task) {
+          .run = run, .pic = pic, .other = other, .arg = arg,
+          .x0 = x0, .y0 = y0, .x1 = x1, .y1 = y1
+        };
+      }
+    }
+    run_tasks(tasks, count);
+    free(tasks);
+  }
+
+// ----------------------------- task bodies ----------------------------- \\
+
+  static void invert_task(struct tile_task *task){
+    invert_rows(task->pic, task->y0, task->y1);
+  }
+
+  static void grayscale_task(struct tile_task *task){
+    grayscale_rows(task->pic, task->y0, task->y1);
+  }
+
+  static void pointwise_task(struct tile_task *task){
+    pointwise_rows(task->pic, task->data, task->arg, task->y0, task->y1);
+  }
+
+  static void flip_task(struct tile_task *task){
+    flip_rows(task->pic, (char) task->arg, task->y0, task->y1);
+  }
+
+  static void half_turn_task(struct tile_task *task){
+    half_turn_rows(task->pic, task->y0, task->y1);
+  }
+
+  static void transpose_task(struct tile_task *task){
+    transpose_tile(task->pic, task->other, task->arg & ROWS_BOTTOM_UP, task->arg & COLS_RIGHT_TO_LEFT,
+      task->x0, task->y0, task->x1, task->y1);
+  }
+
+  static void convolve_task(struct tile_task *task){
+    convolve_rows(task->other, task->pic, task->data, task->y0, task->y1);
+  }
+
+  static void blur_task(struct tile_task *task){
+    // every task has its own pair of tile buffers
+    unsigned char *buffers = malloc(blur_buffer_size(task->x1 - task->x0, task->y1 - task->y0, task->arg));
+    blur_tile(task->other, task->pic, task->arg, task->x0, task->y0, task->x1, task->y1, buffers);
+    free(buffers);
+  }
+
+// ------------------------- parallel transformations ------------------------- \\
+
+  void invert_picture_parallel(struct picture *pic){
+    if(worker_count <= 1){
+      invert_picture(pic);
+      return;
+    }
+    run_bands(invert_task, pic, NULL, 0, NULL, pic->height);
+  }
+
+  void grayscale_picture_parallel(struct picture *pic){
+    if(worker_count <= 1){
+      grayscale_picture(pic);
+      return;
+    }
+    run_bands(grayscale_task, pic, NULL, 0, NULL, pic->height);
+  }
+
+  void pointwise_picture_parallel(struct picture *pic, const enum pointwise_op *ops, int no_ops){
+    if(worker_count <= 1){
+      pointwise_picture(pic, ops, no_ops);
+      return;
+    }
+    run_bands(pointwise_task, pic, NULL, no_ops, ops, pic->height);
+  }
+
+  void rotate_picture_parallel(struct picture *pic, int angle){
+    apply_geometry_parallel(pic, rotate_geometry(angle));
+  }
+
+  void flip_picture_parallel(struct picture *pic, char plane){
+    struct geometry flip = flip_geometry(plane);
+    printf("flipping over %c plane\n", plane);
+    apply_geometry_parallel(pic, flip);
+  }
+
+  void apply_geometry_parallel(struct picture *pic, struct geometry geom){
+    if(worker_count <= 1){
+      apply_geometry(pic, geom);
+      return;
+    }
+
+    // same cases as apply_geometry
+    if(!is_transposing_geometry(geom)){
+      if(geom.xx == -1 && geom.yy == -1){
+        run_bands(half_turn_task, pic, NULL, 0, NULL, (pic->height + 1) / 2);
+      } else if(geom.xx == -1){
+        run_bands(flip_task, pic, NULL, 'H', NULL, pic->height);
+      } else if(geom.yy == -1){
+        run_bands(flip_task, pic, NULL, 'V', NULL, pic->height / 2);
+      }
+      return;
+    }
+
+    int flags = (geom.xy == -1 ? ROWS_BOTTOM_UP : 0) | (geom.yx == -1 ? COLS_RIGHT_TO_LEFT : 0);
+    struct picture out;
+    init_picture_from_size_as(&out, pic->height, pic->width, pic->format);
+    run_tiles(transpose_task, pic, &out, flags, TRANSPOSE_TILE_SIZE);
+    clear_picture(pic);
+    *pic = out;
+  }
+
+  void blur_picture_parallel(struct picture *pic){
+    blur_picture_n_parallel(pic, 1);
+  }
+
+  void blur_picture_n_parallel(struct picture *pic, int n){
+    if(worker_count <= 1 || n < 1 || pic->width < 3 || pic->height < 3){
+      blur_picture_n(pic, n);
+      return;
+    }
+
+    // tiles read from a snapshot of the picture and write straight into it
+    struct picture src;
+    init_picture_from_copy(&src, pic, BYTE_PIXELS);
+    run_tiles(blur_task, pic, &src, n, blur_tile_size(n));
+    clear_picture(&src);
+  }
+
+  void convolve_picture_parallel(struct picture *pic, const int *kernel, int kw, int kh, int divisor, enum border_mode border){
+    if(worker_count <= 1){
+      convolve_picture(pic, kernel, kw, kh, divisor, border);
+      return;
+    }
+
+    // bands read from a snapshot of the picture and write straight into it
+    struct convolution conv;
+    init_convolution(&conv, kernel, kw, kh, divisor, border);
+    struct picture src;
+    init_picture_from_copy(&src, pic, BYTE_PIXELS);
+    run_bands(convolve_task, pic, &src, 0, &conv, pic->height);
+    clear_picture(&src);
+    clear_convolution(&conv);
+  }
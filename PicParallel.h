@@ -0,0 +1,39 @@
+#ifndef PICPARALLEL_H
+#define PICPARALLEL_H
+
+#include "Picture.h"
+#include "PicProcess.h"
+#include "PicGeometry.h"
+#include "Utils.h"
+
+  // Parallel versions of the picture transformation routines. The work is 
+  // cut into row bands or tiles that are shared out between a persistent 
+  // pool of worker threads, and every version produces exactly the same 
+  // picture as its sequential counterpart in PicProcess.h.
+
+  // the workers can be a thread pool taking whole bands and tiles from a 
+  // shared queue, or a work-stealing scheduler (WorkStealing.h) that cuts 
+  // the bands and tiles up as it goes
+  enum worker_kind { POOL_WORKERS, STEALING_WORKERS };
+
+  // start the worker pool with the given number of threads (replacing any 
+  // previous pool); with one thread or fewer the parallel versions simply 
+  // run the sequential routines
+  void init_workers(int threads);
+  void init_workers_of(enum worker_kind kind, int threads);
+  void clear_workers(void);
+  int get_worker_count(void);
+  enum worker_kind get_worker_kind(void);
+
+  // parallel picture transformation routines
+  void invert_picture_parallel(struct picture *pic);
+  void grayscale_picture_parallel(struct picture *pic);
+  void pointwise_picture_parallel(struct picture *pic, const enum pointwise_op *ops, int no_ops);
+  void rotate_picture_parallel(struct picture *pic, int angle);
+  void flip_picture_parallel(struct picture *pic, char plane);
+  void apply_geometry_parallel(struct picture *pic, struct geometry geom);
+  void blur_picture_parallel(struct picture *pic);
+  void blur_picture_n_parallel(struct picture *pic, int n);
+  void convolve_picture_parallel(struct picture *pic, const int *kernel, int kw, int kh, int divisor, enum border_mode border);
+
+#endif
@@ -1,134 +1,533 @@
 #include "PicProcess.h"
+#include "PicKernels.h"
+#include "PicGeometry.h"
+#include <string.h>
 
-  #define NO_RGB_COMPONENTS 3
   #define BLUR_REGION_SIZE 9
+  #define BLUR_TILE_SIZE 256
 
+  // The routines below work on rows of 0-255 values obtained through
+  // load_row/store_row, so byte pictures are processed in place and float
+  // pictures are converted a row at a time.
+
+  // row to build output values in: the row itself for byte pictures, else scratch
+  static unsigned char *output_row(struct picture *pic, int rgb, int y, unsigned char *scratch){
+    return pic->format == BYTE_PIXELS ? get_byte_row(pic, rgb, y) : scratch;
+  }
 
   void invert_picture(struct picture *pic){
-    for(int i = 0 ; i < pic->width; i++){
-      for(int j = 0 ; j < pic->height; j++){
-        struct pixel rgb = get_pixel(pic, i, j);
-        rgb.red = MAX_PIXEL_INTENSITY - rgb.red;
-        rgb.green = MAX_PIXEL_INTENSITY - rgb.green;
-        rgb.blue = MAX_PIXEL_INTENSITY - rgb.blue;
-        set_pixel(pic, i, j, &rgb);
-      }
-    }   
+    invert_rows(pic, 0, pic->height);
+  }
+
+  void invert_rows(struct picture *pic, int y0, int y1){
+    enum pointwise_op op = INVERT_OP;
+    pointwise_rows(pic, &op, 1, y0, y1);
   }
 
   void grayscale_picture(struct picture *pic){
-    for(int i = 0 ; i < pic->width; i++){
-      for(int j = 0 ; j < pic->height; j++){
-        struct pixel rgb = get_pixel(pic, i, j);
-        int avg = (rgb.red + rgb.green + rgb.blue) / NO_RGB_COMPONENTS;
-        rgb.red = avg;
-        rgb.green = avg;
-        rgb.blue = avg;
-        set_pixel(pic, i, j, &rgb);
+    grayscale_rows(pic, 0, pic->height);
+  }
+
+  void grayscale_rows(struct picture *pic, int y0, int y1){
+    enum pointwise_op op = GRAYSCALE_OP;
+    pointwise_rows(pic, &op, 1, y0, y1);
+  }
+
+  void pointwise_picture(struct picture *pic, const enum pointwise_op *ops, int no_ops){
+    pointwise_rows(pic, ops, no_ops, 0, pic->height);
+  }
+
+  // Each row is loaded once (all three planes, as grayscale mixes them), 
+  // every operation is applied to it while it is in cache, and it is stored 
+  // once.
+  void pointwise_rows(struct picture *pic, const enum pointwise_op *ops, int no_ops, int y0, int y1){
+    int width = pic->width;
+    unsigned char *scratch = malloc(NO_RGB_PLANES * width);
+    for(int j = y0; j < y1; j++){
+      unsigned char *rows[NO_RGB_PLANES];
+      for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+        rows[rgb] = load_row(pic, rgb, j, scratch + rgb * width);
+      }
+      for(int k = 0; k < no_ops; k++){
+        if(ops[k] == INVERT_OP){
+          for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+            invert_row(rows[rgb], width);
+          }
+        } else {
+          grayscale_row(rows[RED], rows[GREEN], rows[BLUE], width);
+        }
+      }
+      for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+        store_row(pic, rgb, j, rows[rgb]);
       }
-    }    
+    }
+    free(scratch);
   }
 
-  void rotate_picture(struct picture *pic, int angle){
-    struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height; 
-  
-    int new_width = tmp.width;
-    int new_height = tmp.height;
-  
-    if(angle == 90 || angle == 270){
-      new_width = tmp.height;
-      new_height = tmp.width;
-    }
-    
-    clear_picture(pic);
-    init_picture_from_size(pic, new_width, new_height);
-  
-    for(int i = 0 ; i < new_width; i++){
-      for(int j = 0 ; j < new_height; j++){
-        struct pixel rgb;
-        switch(angle){
-          case(90):
-            rgb = get_pixel(&tmp, j, new_width -1 - i); 
-            break;
-          case(180):
-            rgb = get_pixel(&tmp, new_width - 1 - i, new_height - 1 - j);
-            break;
-          case(270):
-            rgb = get_pixel(&tmp, new_height - 1 - j, i);
-            break;
-          default:
-            printf("[!] rotate is undefined for angle %i (must be 90, 180 or 270)\n", angle);
-            clear_picture(&tmp);
-            exit(IO_ERROR);
-            return;
+  // Float pictures are flipped and rotated by moving their floats around
+  // directly, as that is exact; these are the float counterparts of the
+  // reverse_row/reverse_swap_rows byte kernels.
+  static void reverse_float_row(float *row, int n){
+    for(int i = 0, j = n - 1; i < j; i++, j--){
+      float tmp = row[i];
+      row[i] = row[j];
+      row[j] = tmp;
+    }
+  }
+
+  static void reverse_swap_float_rows(float *restrict a, float *restrict b, int n){
+    for(int i = 0; i < n; i++){
+      float tmp = a[i];
+      a[i] = b[n - 1 - i];
+      b[n - 1 - i] = tmp;
+    }
+  }
+
+  // exchange the contents of two distinct rows of size bytes
+  static void swap_rows(void *restrict a, void *restrict b, size_t size){
+    unsigned char *x = a;
+    unsigned char *y = b;
+    for(size_t i = 0; i < size; i++){
+      unsigned char tmp = x[i];
+      x[i] = y[i];
+      y[i] = tmp;
+    }
+  }
+
+  // Reverse rows [y0, y1) of the picture in place, and with upside_down also
+  // exchange each of them with its mirror row (a 180 degree rotation).
+  static void mirror_rows(struct picture *pic, bool upside_down, int y0, int y1){
+    int width = pic->width;
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      for(int top = y0; top < y1; top++){
+        int bottom = upside_down ? pic->height - 1 - top : top;
+        if(top < bottom){
+          if(pic->format == BYTE_PIXELS){
+            reverse_swap_rows(get_byte_row(pic, rgb, top), get_byte_row(pic, rgb, bottom), width);
+          } else {
+            reverse_swap_float_rows(get_row(pic, rgb, top), get_row(pic, rgb, bottom), width);
+          }
+        } else if(top == bottom){
+          // rows that stay where they are only need reversing
+          if(pic->format == BYTE_PIXELS){
+            reverse_row(get_byte_row(pic, rgb, top), width);
+          } else {
+            reverse_float_row(get_row(pic, rgb, top), width);
+          }
         }
-        set_pixel(pic, i,j, &rgb);
       }
     }
-    clear_picture(&tmp);
+  }
+
+  void half_turn_rows(struct picture *pic, int y0, int y1){
+    mirror_rows(pic, true, y0, y1);
+  }
+
+  void transpose_tile(struct picture *pic, struct picture *out, bool rows_bottom_up, bool cols_right_to_left, int x0, int y0, int x1, int y1){
+    // Reading the rows bottom up or writing the transposed rows bottom up 
+    // (negative strides) flips the picture on the way; for a region, the 
+    // transpose starts at the region's corner in both pictures.
+    int width = pic->width;
+    int height = pic->height;
+    int src_y = rows_bottom_up ? y1 - 1 : y0;
+    int dst_x = rows_bottom_up ? height - y1 : y0;
+    int dst_y = cols_right_to_left ? width - 1 - x0 : x0;
+    ptrdiff_t src_stride = rows_bottom_up ? -width : width;
+    ptrdiff_t dst_stride = cols_right_to_left ? -height : height;
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      if(pic->format == BYTE_PIXELS){
+        transpose_bytes(get_byte_row(pic, rgb, src_y) + x0, src_stride, get_byte_row(out, rgb, dst_y) + dst_x, dst_stride, y1 - y0, x1 - x0);
+      } else {
+        transpose_floats(get_row(pic, rgb, src_y) + x0, src_stride, get_row(out, rgb, dst_y) + dst_x, dst_stride, y1 - y0, x1 - x0);
+      }
+    }
+  }
+
+  void rotate_picture(struct picture *pic, int angle){
+    apply_geometry(pic, rotate_geometry(angle));
   }
 
   void flip_picture(struct picture *pic, char plane){
-    struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;  
-    
-    if(plane == 'V'){
-      printf("flipping over V plane\n");
-      for(int i = 0 ; i < tmp.width; i++){
-        for(int j = 0 ; j < tmp.height; j++){
-          struct pixel rgb = get_pixel(&tmp, i, tmp.height - 1 - j);
-          set_pixel(pic, i, j, &rgb);
+    struct geometry flip = flip_geometry(plane);
+    printf("flipping over %c plane\n", plane);
+    apply_geometry(pic, flip);
+  }
+
+  void flip_rows(struct picture *pic, char plane, int y0, int y1){
+    if(plane == 'H'){
+      mirror_rows(pic, false, y0, y1);
+      return;
+    }
+    size_t row_size = pic->width * (pic->format == BYTE_PIXELS ? sizeof(unsigned char) : sizeof(float));
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      for(int top = y0; top < y1; top++){
+        int bottom = pic->height - 1 - top;
+        if(top >= bottom){
+          continue;
+        }
+        if(pic->format == BYTE_PIXELS){
+          swap_rows(get_byte_row(pic, rgb, top), get_byte_row(pic, rgb, bottom), row_size);
+        } else {
+          swap_rows(get_row(pic, rgb, top), get_row(pic, rgb, bottom), row_size);
         }
       }
-    } else if (plane == 'H'){
-      printf("flipping over H plane\n");  
-      for(int i = 0 ; i < tmp.width; i++){
-        for(int j = 0 ; j < tmp.height; j++){
-          struct pixel rgb = get_pixel(&tmp, tmp.width - 1 - i, j);
-          set_pixel(pic, i, j, &rgb);
+    }
+  }
+
+  // sums[i] = row[i-1] + row[i] + row[i+1] for the interior positions of a row
+  static void horizontal_sums(const unsigned char *row, unsigned short *sums, int width){
+    for(int i = 1 ; i < width - 1; i++){
+      sums[i] = row[i-1] + row[i] + row[i+1];
+    }
+  }
+
+  // The 3x3 box is separated into a horizontal 3-tap sum per row and a 
+  // vertical running sum of those, so each pixel costs a constant number of 
+  // additions. Rows are consumed top to bottom and every source row is read 
+  // before it is overwritten, so the picture is blurred in place with only a 
+  // few rows of working memory.
+  void blur_picture(struct picture *pic){
+    int width = pic->width;
+    int height = pic->height;
+    if(width < 3 || height < 3){
+      return;
+    }
+
+    unsigned char *scratch = malloc(3 * width);
+    unsigned short *sums = malloc(4 * width * sizeof(unsigned short));
+    unsigned short *window = sums + 3 * width;
+
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      // sums holds a ring of the horizontal sums of the last three rows
+      unsigned char *centre = load_row(pic, rgb, 0, scratch);
+      horizontal_sums(centre, sums, width);
+      centre = load_row(pic, rgb, 1, scratch + width);
+      horizontal_sums(centre, sums + width, width);
+      for(int i = 1 ; i < width - 1; i++){
+        window[i] = sums[i] + sums[width + i];
+      }
+
+      for(int j = 1 ; j < height - 1; j++){
+        unsigned char *below = load_row(pic, rgb, j + 1, scratch + ((j + 1) % 2) * width);
+        unsigned short *entering = sums + ((j + 1) % 3) * width;
+        unsigned short *leaving = sums + ((j + 2) % 3) * width;
+        horizontal_sums(below, entering, width);
+
+        // the left and right edge pixels are left as they are
+        unsigned char *dst = output_row(pic, rgb, j, scratch + 2 * width);
+        dst[0] = centre[0];
+        dst[width - 1] = centre[width - 1];
+        for(int i = 1 ; i < width - 1; i++){
+          int sum = window[i] + entering[i];
+          dst[i] = sum / BLUR_REGION_SIZE;
+          // slide the window down: drop row j - 1, keep rows j and j + 1
+          window[i] = sum - leaving[i];
         }
-      }    
-    } else {
-      printf("[!] flip is undefined for plane %c\n", plane);
+        store_row(pic, rgb, j, dst);
+        centre = below;
+      }
+    }
+    free(sums);
+    free(scratch);
+  }
+
+  // One blur pass over the rectangle [x0,x1) x [y0,y1) of a tile buffer whose 
+  // top left corner sits at (tx,ty) in a width x height picture. Pixels on the
+  // border of the picture are carried over unchanged, as in blur_picture.
+  static void blur_tile_pass(const unsigned char *restrict src, unsigned char *restrict dst, int stride,
+                             int x0, int x1, int y0, int y1, int tx, int ty, int width, int height){
+    for(int y = y0; y < y1; y++){
+      const unsigned char *centre = src + y * stride;
+      unsigned char *out = dst + y * stride;
+      if(ty + y == 0 || ty + y == height - 1){
+        memcpy(out + x0, centre + x0, x1 - x0);
+        continue;
+      }
+
+      const unsigned char *above = centre - stride;
+      const unsigned char *below = centre + stride;
+      int from = x0;
+      int to = x1;
+      if(tx + from == 0){
+        out[from] = centre[from];
+        from++;
+      }
+      if(tx + to == width){
+        out[to - 1] = centre[to - 1];
+        to--;
+      }
+      for(int x = from; x < to; x++){
+        int sum = above[x-1] + above[x] + above[x+1]
+                + centre[x-1] + centre[x] + centre[x+1]
+                + below[x-1] + below[x] + below[x+1];
+        out[x] = sum / BLUR_REGION_SIZE;
+      }
+    }
+  }
+
+  int blur_tile_size(int n){
+    // keep the recomputed halo small relative to the tile
+    return BLUR_TILE_SIZE < 4 * n ? 4 * n : BLUR_TILE_SIZE;
+  }
+
+  size_t blur_buffer_size(int tile_width, int tile_height, int n){
+    return 2 * (size_t) (tile_width + 2 * n) * (tile_height + 2 * n);
+  }
+
+  // The tile is read once, together with a halo of n pixels, into the first
+  // of two tile buffers. All n passes are then run between those two buffers
+  // while the tile stays in cache: every pass invalidates one more pixel of 
+  // the halo, so after n passes exactly the tile itself holds fully blurred 
+  // values.
+  void blur_tile(struct picture *src, struct picture *pic, int n, int tx0, int ty0, int tx1, int ty1, unsigned char *buffers){
+    int width = pic->width;
+    int height = pic->height;
+    int stride = tx1 - tx0 + 2 * n;
+
+    // the tile plus its halo, clipped to the picture
+    int ex0 = tx0 - n > 0 ? tx0 - n : 0;
+    int ey0 = ty0 - n > 0 ? ty0 - n : 0;
+    int ex1 = tx1 + n < width ? tx1 + n : width;
+    int ey1 = ty1 + n < height ? ty1 + n : height;
+
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      unsigned char *cur = buffers;
+      unsigned char *next = buffers + blur_buffer_size(tx1 - tx0, ty1 - ty0, n) / 2;
+      for(int y = ey0; y < ey1; y++){
+        load_span(src, rgb, ex0, y, ex1 - ex0, cur + (y - ey0) * stride);
+      }
+
+      // region of the buffer still holding valid values; it only shrinks 
+      // on the sides where the halo did not hit the edge of the picture
+      int x0 = 0;
+      int x1 = ex1 - ex0;
+      int y0 = 0;
+      int y1 = ey1 - ey0;
+      for(int k = 0; k < n; k++){
+        if(ex0 > 0) x0++;
+        if(ex1 < width) x1--;
+        if(ey0 > 0) y0++;
+        if(ey1 < height) y1--;
+        blur_tile_pass(cur, next, stride, x0, x1, y0, y1, ex0, ey0, width, height);
+        unsigned char *swap = cur;
+        cur = next;
+        next = swap;
+      }
+
+      for(int y = ty0; y < ty1; y++){
+        store_span(pic, rgb, tx0, y, tx1 - tx0, cur + (y - ey0) * stride + (tx0 - ex0));
+      }
+    }
+  }
+
+  // The picture is cut into tiles which are blurred one after the other with
+  // the same pair of tile buffers. Tiles read from a byte snapshot of the 
+  // picture, so the results do not depend on the order they are done in.
+  void blur_picture_n(struct picture *pic, int n){
+    if(n <= 1){
+      if(n == 1){
+        blur_picture(pic);
+      }
+      return;
+    }
+
+    int width = pic->width;
+    int height = pic->height;
+    if(width < 3 || height < 3){
+      return;
+    }
+
+    int tile = blur_tile_size(n);
+    struct picture src;
+    init_picture_from_copy(&src, pic, BYTE_PIXELS);
+    unsigned char *buffers = malloc(blur_buffer_size(tile, tile, n));
+
+    for(int ty0 = 0; ty0 < height; ty0 += tile){
+      for(int tx0 = 0; tx0 < width; tx0 += tile){
+        int tx1 = tx0 + tile < width ? tx0 + tile : width;
+        int ty1 = ty0 + tile < height ? ty0 + tile : height;
+        blur_tile(&src, pic, n, tx0, ty0, tx1, ty1, buffers);
+      }
+    }
+    free(buffers);
+    clear_picture(&src);
+  }
+
+  static int gcd(int a, int b){
+    while(b != 0){
+      int r = a % b;
+      a = b;
+      b = r;
+    }
+    return a;
+  }
+
+  // A kernel is separable when every row is a multiple of one primitive 
+  // integer row: taking that row from the first non-zero row, the multiples
+  // make up the column and the kernel is their (exact) outer product.
+  static bool split_kernel(const int *kernel, int kw, int kh, int *row, int *col){
+    const int *base = NULL;
+    int pivot = 0;
+    for(int j = 0; j < kh && base == NULL; j++){
+      for(int i = 0; i < kw; i++){
+        if(kernel[j * kw + i] != 0){
+          base = kernel + j * kw;
+          pivot = i;
+          break;
+        }
+      }
+    }
+    if(base == NULL){
+      return false;
+    }
+
+    int divisor = 0;
+    for(int i = 0; i < kw; i++){
+      divisor = gcd(divisor, abs(base[i]));
+    }
+    for(int i = 0; i < kw; i++){
+      row[i] = base[i] / divisor;
+    }
+    for(int j = 0; j < kh; j++){
+      col[j] = kernel[j * kw + pivot] / row[pivot];
+      for(int i = 0; i < kw; i++){
+        if(kernel[j * kw + i] != col[j] * row[i]){
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  void init_convolution(struct convolution *conv, const int *kernel, int kw, int kh, int divisor, enum border_mode border){
+    if(kw < 1 || kh < 1 || kw % 2 == 0 || kh % 2 == 0){
+      printf("[!] convolve is undefined for a %ix%i kernel (sides must be odd)\n", kw, kh);
       exit(IO_ERROR);
-    }  
-    clear_picture(&tmp);
+    }
+    if(divisor == 0){
+      printf("[!] convolve is undefined for divisor 0\n");
+      exit(IO_ERROR);
+    }
+    conv->kernel = kernel;
+    conv->kw = kw;
+    conv->kh = kh;
+    conv->divisor = divisor;
+    conv->border = border;
+    conv->row = malloc(kw * sizeof(int));
+    conv->col = malloc(kh * sizeof(int));
+    conv->separable = split_kernel(kernel, kw, kh, conv->row, conv->col);
   }
 
-  void blur_picture(struct picture *pic){
-    struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;  
-  
-    for(int i = 1 ; i < tmp.width - 1; i++){
-      for(int j = 1 ; j < tmp.height - 1; j++){
-          
-        struct pixel rgb;  
-        int sum_red = 0;
-        int sum_green = 0;
-        int sum_blue = 0;
-      
-        for(int n = -1; n <= 1; n++){
-          for(int m = -1; m <= 1; m++){
-            rgb = get_pixel(&tmp, i+n, j+m);
-            sum_red += rgb.red;
-            sum_green += rgb.green;
-            sum_blue += rgb.blue;
+  void clear_convolution(struct convolution *conv){
+    free(conv->row);
+    free(conv->col);
+  }
+
+  // Load row y of src with kw / 2 values of padding on either side, as the
+  // border mode says (rows outside the picture are those of the nearest 
+  // edge, or zero), and for separable kernels its horizontal pass into sums.
+  static void load_padded_row(struct picture *src, int rgb, int y, const struct convolution *conv, unsigned char *padded, int *sums){
+    int width = src->width;
+    int rx = conv->kw / 2;
+    bool zero = conv->border == BORDER_ZERO;
+    if(zero && (y < 0 || y >= src->height)){
+      memset(padded, 0, width + 2 * rx);
+    } else {
+      y = y < 0 ? 0 : (y >= src->height ? src->height - 1 : y);
+      load_span(src, rgb, 0, y, width, padded + rx);
+      for(int i = 0; i < rx; i++){
+        padded[i] = zero ? 0 : padded[rx];
+        padded[rx + width + i] = zero ? 0 : padded[rx + width - 1];
+      }
+    }
+    if(conv->separable){
+      memset(sums, 0, width * sizeof(int));
+      for(int i = 0; i < conv->kw; i++){
+        multiply_add_bytes(sums, padded + i, conv->row[i], width);
+      }
+    }
+  }
+
+  static void divide_row(const int *restrict acc, int divisor, unsigned char *restrict out, int n){
+    for(int i = 0; i < n; i++){
+      // (the double quotient truncates exactly like int division here, and 
+      // unlike it can be vectorised)
+      int value = (int) ((double) acc[i] / divisor);
+      out[i] = value < 0 ? 0 : (value > MAX_RGB_VALUE ? MAX_RGB_VALUE : value);
+    }
+  }
+
+  // The source rows around the current row are kept (padded) in a ring of 
+  // kh rows, and for separable kernels so are their horizontal sums. Row 
+  // y + kh / 2 is loaded before row y is written, which is why src may be 
+  // the picture being written.
+  void convolve_rows(struct picture *src, struct picture *pic, const struct convolution *conv, int y0, int y1){
+    int width = pic->width;
+    int height = pic->height;
+    int kw = conv->kw;
+    int kh = conv->kh;
+    int rx = kw / 2;
+    int ry = kh / 2;
+    if(conv->border == BORDER_KEEP){
+      // only pixels whose neighbourhood fits in the picture change
+      if(width < kw){
+        return;
+      }
+      y0 = y0 > ry ? y0 : ry;
+      y1 = y1 < height - ry ? y1 : height - ry;
+    }
+    if(y0 >= y1){
+      return;
+    }
+
+    int stride = width + 2 * rx;
+    unsigned char *rows = malloc(kh * stride);
+    int *sums = malloc(kh * width * sizeof(int));
+    int *acc = malloc(width * sizeof(int));
+    unsigned char *out = malloc(width);
+
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      for(int y = y0 - ry; y < y0 + ry; y++){
+        int slot = ((y % kh) + kh) % kh;
+        load_padded_row(src, rgb, y, conv, rows + slot * stride, sums + slot * width);
+      }
+      for(int y = y0; y < y1; y++){
+        int slot = ((y + ry) % kh + kh) % kh;
+        load_padded_row(src, rgb, y + ry, conv, rows + slot * stride, sums + slot * width);
+
+        memset(acc, 0, width * sizeof(int));
+        for(int j = 0; j < kh; j++){
+          slot = ((y - ry + j) % kh + kh) % kh;
+          if(conv->separable){
+            multiply_add_ints(acc, sums + slot * width, conv->col[j], width);
+            continue;
+          }
+          for(int i = 0; i < kw; i++){
+            int k = conv->kernel[j * kw + i];
+            if(k != 0){
+              multiply_add_bytes(acc, rows + slot * stride + i, k, width);
+            }
           }
         }
-      
-        rgb.red = sum_red / BLUR_REGION_SIZE;
-        rgb.green = sum_green / BLUR_REGION_SIZE;
-        rgb.blue = sum_blue / BLUR_REGION_SIZE;
-      
-        set_pixel(pic, i, j, &rgb);
+        divide_row(acc, conv->divisor, out, width);
+
+        if(conv->border == BORDER_KEEP){
+          const unsigned char *centre = rows + ((y % kh) + kh) % kh * stride + rx;
+          memcpy(out, centre, rx);
+          memcpy(out + width - rx, centre + width - rx, rx);
+        }
+        store_row(pic, rgb, y, out);
       }
     }
-    clear_picture(&tmp);
+    free(rows);
+    free(sums);
+    free(acc);
+    free(out);
+  }
+
+  void convolve_picture(struct picture *pic, const int *kernel, int kw, int kh, int divisor, enum border_mode border){
+    struct convolution conv;
+    init_convolution(&conv, kernel, kw, kh, divisor, border);
+    convolve_rows(pic, pic, &conv, 0, pic->height);
+    clear_convolution(&conv);
   }
@@ -11,5 +11,79 @@
   void flip_picture(struct picture *pic, char plane);
   void blur_picture(struct picture *pic);
 
+  // same result as n successive calls to blur_picture, in a single sweep
+  void blur_picture_n(struct picture *pic, int n);
+
+  // how convolve_picture treats pixels whose neighbourhood leaves the picture
+  enum border_mode {
+    BORDER_KEEP,    // they keep their value (as with blur_picture)
+    BORDER_CLAMP,   // the edge pixels are repeated outwards
+    BORDER_ZERO     // the missing neighbours count as 0
+  };
+
+  // Replace every pixel with the sum of its kw x kh neighbourhood (centred on
+  // it, so both sides must be odd) weighted by kernel (kh rows of kw values),
+  // divided by divisor, truncated and clamped to 0-255. Separable kernels 
+  // are applied as a horizontal and a vertical pass.
+  void convolve_picture(struct picture *pic, const int *kernel, int kw, int kh, int divisor, enum border_mode border);
+
+  // per-pixel transformations, which can be chained into a single pass
+  enum pointwise_op {INVERT_OP, GRAYSCALE_OP};
+
+  // same result as applying each of the no_ops operations in turn, in one
+  // pass over the picture
+  void pointwise_picture(struct picture *pic, const enum pointwise_op *ops, int no_ops);
+
+  // Pieces of the routines above that each work on part of a picture, so 
+  // they can be shared out between threads (see PicParallel.h). Running a 
+  // piece over the whole picture is exactly what the routine itself does.
+
+  // invert / grayscale rows [y0, y1)
+  void invert_rows(struct picture *pic, int y0, int y1);
+  void grayscale_rows(struct picture *pic, int y0, int y1);
+  void pointwise_rows(struct picture *pic, const enum pointwise_op *ops, int no_ops, int y0, int y1);
+
+  // flip rows [y0, y1): over the H plane each row is reversed, over the V
+  // plane each row is exchanged with its mirror, so only rows in the top 
+  // half (below height / 2) need to be given
+  void flip_rows(struct picture *pic, char plane, int y0, int y1);
+
+  // rotate by 180 degrees by exchanging each row in [y0, y1) with its 
+  // reversed mirror; only rows below (height + 1) / 2 need to be given
+  void half_turn_rows(struct picture *pic, int y0, int y1);
+
+  // write the part of the transpose of pic that comes from its [x0, x1) x
+  // [y0, y1) region into out (a height x width picture), reading pic upside
+  // down (rows_bottom_up) and/or mirrored (cols_right_to_left) on the way; 
+  // this covers the quarter turns, e.g. rotating by 90 degrees reads the 
+  // rows bottom up
+  void transpose_tile(struct picture *pic, struct picture *out, bool rows_bottom_up, bool cols_right_to_left, int x0, int y0, int x1, int y1);
+
+  // write the [x0, x1) x [y0, y1) region of n blurs of src into pic, using
+  // buffers of at least blur_buffer_size(x1 - x0, y1 - y0, n) bytes
+  void blur_tile(struct picture *src, struct picture *pic, int n, int x0, int y0, int x1, int y1, unsigned char *buffers);
+  size_t blur_buffer_size(int tile_width, int tile_height, int n);
+
+  // side of the square tiles blur_picture_n splits a picture into
+  int blur_tile_size(int n);
+
+  // a kernel checked (exactly as convolve_picture does) and prepared for
+  // convolve_rows; for separable kernels kernel[j * kw + i] = col[j] * row[i]
+  struct convolution {
+    const int *kernel;
+    int kw, kh;
+    int divisor;
+    enum border_mode border;
+    bool separable;
+    int *row;
+    int *col;
+  };
+  void init_convolution(struct convolution *conv, const int *kernel, int kw, int kh, int divisor, enum border_mode border);
+  void clear_convolution(struct convolution *conv);
+
+  // write rows [y0, y1) of the convolution of src into pic; src may be pic
+  // itself as long as the rows are done in one call, from the top down
+  void convolve_rows(struct picture *src, struct picture *pic, const struct convolution *conv, int y0, int y1);
+
 #endif
 
@@ -1,51 +1,234 @@
 #include "Picture.h"
+#include "PicKernels.h"
+#include <string.h>
+#include <math.h>
+
+  // rows of random values drawn at a time by init_picture_from_random
+  #define RANDOM_STRIP_ROWS 64
 
   bool init_picture_from_file(struct picture *pic, const char *path){
+    return init_picture_from_file_as(pic, path, FLOAT_PIXELS);
+  }
+
+  bool init_picture_from_size(struct picture *pic, int width, int height){
+    return init_picture_from_size_as(pic, width, height, FLOAT_PIXELS);
+  }
+
+  bool init_picture_from_file_as(struct picture *pic, const char *path, enum pixel_format format){
+    pic->format = format;
+    pic->img.data = 0;
+    pic->bytes = NULL;
+    if(format == BYTE_PIXELS){
+      pic->bytes = load_image_bytes(path, &pic->width, &pic->height);
+      return pic->bytes != NULL;
+    }
     pic->img = load_image(path);
     if( pic->img.data == 0 ){
       return false;
-    }    
+    }
     pic->width = get_image_width(pic->img);
     pic->height = get_image_height(pic->img);
     return true;
   }
 
-  bool init_picture_from_size(struct picture *pic, int width, int height){
-    pic->img = create_image(width, height);
+  bool init_picture_from_size_as(struct picture *pic, int width, int height, enum pixel_format format){
+    pic->format = format;
+    pic->img.data = 0;
+    pic->bytes = NULL;
+    if(format == BYTE_PIXELS){
+      pic->bytes = create_image_bytes(width, height);
+    } else {
+      pic->img = create_image(width, height);
+    }
     pic->width = width;
     pic->height = height;
     return true;
   }
 
-  bool save_picture_to_file(struct picture *pic, const char *path){
-    return save_image(pic->img, path);   
+  bool init_picture_from_copy(struct picture *pic, struct picture *src, enum pixel_format format){
+    if(format == src->format){
+      pic->format = format;
+      pic->img.data = 0;
+      pic->bytes = NULL;
+      if(format == BYTE_PIXELS){
+        pic->bytes = copy_image_bytes(src->bytes, src->width, src->height);
+      } else {
+        pic->img = copy_image(src->img);
+      }
+      pic->width = src->width;
+      pic->height = src->height;
+      return true;
+    }
+
+    // converting copy: go through the format-independent row interface
+    init_picture_from_size_as(pic, src->width, src->height, format);
+    unsigned char *scratch = malloc(src->width);
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      for(int j = 0; j < src->height; j++){
+        store_row(pic, rgb, j, load_row(src, rgb, j, scratch));
+      }
+    }
+    free(scratch);
+    return true;
   }
 
-  // enum mapping to support get/set pixel functions
-  enum RGB {RED, GREEN, BLUE};
+  bool init_picture_from_random(struct picture *pic, int width, int height, enum pixel_format format){
+    // sod draws whole float images, so the planes are drawn a strip of rows 
+    // at a time to keep even very large pictures cheap to make
+    init_picture_from_size_as(pic, width, height, format);
+    unsigned char *row = malloc(width);
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      for(int y0 = 0; y0 < height; y0 += RANDOM_STRIP_ROWS){
+        int rows = height - y0 < RANDOM_STRIP_ROWS ? height - y0 : RANDOM_STRIP_ROWS;
+        sod_img strip = sod_make_random_image(width, rows, 1);
+        for(int j = 0; j < rows; j++){
+          for(int i = 0; i < width; i++){
+            // the values are normally distributed around 0.5, so clamp them
+            float intensity = strip.data[j * width + i];
+            intensity = intensity < 0 ? 0 : (intensity > 1 ? 1 : intensity);
+            row[i] = TO_RGB_VALUE(intensity);
+          }
+          store_row(pic, rgb, y0 + j, row);
+        }
+        free_image(strip);
+      }
+    }
+    free(row);
+    return true;
+  }
+
+  bool save_picture_to_file(struct picture *pic, const char *path){
+    if(pic->format == BYTE_PIXELS){
+      return save_image_bytes(pic->bytes, pic->width, pic->height, path);
+    }
+    return save_image(pic->img, path);
+  }
 
   struct pixel get_pixel(struct picture *pic, int x, int y){
     // Beware: pixels are stored in a (x,y) vector from the top left of the image.
     struct pixel pix;
-    
+
+    if(pic->format == BYTE_PIXELS){
+      pix.red = get_byte_row(pic, RED, y)[x];
+      pix.green = get_byte_row(pic, GREEN, y)[x];
+      pix.blue = get_byte_row(pic, BLUE, y)[x];
+      return pix;
+    }
+
     pix.red = get_pixel_value(pic->img, RED, x, y);
     pix.green = get_pixel_value(pic->img, GREEN, x, y);
     pix.blue = get_pixel_value(pic->img, BLUE, x, y);
-    
+
     return pix;
   }
 
   void set_pixel(struct picture *pic, int x, int y, struct pixel *rgb){
     // Beware: pixels are stored in a (x,y) vector from the top left of the image.
+    if(pic->format == BYTE_PIXELS){
+      get_byte_row(pic, RED, y)[x] = rgb->red;
+      get_byte_row(pic, GREEN, y)[x] = rgb->green;
+      get_byte_row(pic, BLUE, y)[x] = rgb->blue;
+      return;
+    }
+
     set_pixel_value(pic->img, RED, x, y, rgb->red);
     set_pixel_value(pic->img, GREEN, x, y, rgb->green);
     set_pixel_value(pic->img, BLUE, x, y, rgb->blue);
   }
 
+  int get_row_stride(struct picture *pic){
+    return pic->width;
+  }
+
+  int get_plane_stride(struct picture *pic){
+    return pic->width * pic->height;
+  }
+
+  float *get_row(struct picture *pic, int rgb, int y){
+    return pic->img.data + rgb * get_plane_stride(pic) + y * get_row_stride(pic);
+  }
+
+  unsigned char *get_byte_row(struct picture *pic, int rgb, int y){
+    return pic->bytes + rgb * get_plane_stride(pic) + y * get_row_stride(pic);
+  }
+
+  unsigned char *load_row(struct picture *pic, int rgb, int y, unsigned char *scratch){
+    if(pic->format == BYTE_PIXELS){
+      return get_byte_row(pic, rgb, y);
+    }
+    float *row = get_row(pic, rgb, y);
+    for(int i = 0; i < pic->width; i++){
+      scratch[i] = TO_RGB_VALUE(row[i]);
+    }
+    return scratch;
+  }
+
+  void store_row(struct picture *pic, int rgb, int y, const unsigned char *row){
+    if(pic->format == BYTE_PIXELS){
+      unsigned char *dst = get_byte_row(pic, rgb, y);
+      if(dst != row){
+        memcpy(dst, row, pic->width);
+      }
+      return;
+    }
+    float *dst = get_row(pic, rgb, y);
+    for(int i = 0; i < pic->width; i++){
+      dst[i] = TO_INTENSITY(row[i]);
+    }
+  }
+
+  void load_span(struct picture *pic, int rgb, int x, int y, int n, unsigned char *values){
+    if(pic->format == BYTE_PIXELS){
+      memcpy(values, get_byte_row(pic, rgb, y) + x, n);
+      return;
+    }
+    float *row = get_row(pic, rgb, y) + x;
+    for(int i = 0; i < n; i++){
+      values[i] = TO_RGB_VALUE(row[i]);
+    }
+  }
+
+  void store_span(struct picture *pic, int rgb, int x, int y, int n, const unsigned char *values){
+    if(pic->format == BYTE_PIXELS){
+      memcpy(get_byte_row(pic, rgb, y) + x, values, n);
+      return;
+    }
+    float *row = get_row(pic, rgb, y) + x;
+    for(int i = 0; i < n; i++){
+      row[i] = TO_INTENSITY(values[i]);
+    }
+  }
+
+  bool compare_pictures(struct picture *a, struct picture *b, struct picture_diff *diff){
+    if(a->width != b->width || a->height != b->height){
+      return false;
+    }
+    int width = a->width;
+    unsigned char *scratch = malloc(2 * width);
+    unsigned long long squares = 0;
+    diff->max_diff = 0;
+    for(int rgb = 0; rgb < NO_RGB_PLANES; rgb++){
+      for(int j = 0; j < a->height; j++){
+        int row_diff = diff_row(load_row(a, rgb, j, scratch), load_row(b, rgb, j, scratch + width), width, &squares);
+        diff->max_diff = row_diff > diff->max_diff ? row_diff : diff->max_diff;
+      }
+    }
+    free(scratch);
+
+    double values = (double) NO_RGB_PLANES * width * a->height;
+    diff->mse = values > 0 ? squares / values : 0;
+    diff->psnr = diff->mse > 0 ? 10 * log10(MAX_RGB_VALUE * MAX_RGB_VALUE / diff->mse) : INFINITY;
+    return true;
+  }
+
   bool contains_point(struct picture *pic, int x, int y){
       return x >= 0 && x < pic->width && y >= 0 && y < pic->height;
   }
-  
+
   void clear_picture(struct picture *pic){
-    free_image(pic->img); 
-  }  
+    if(pic->format == BYTE_PIXELS){
+      free_image_bytes(pic->bytes);
+      return;
+    }
+    free_image(pic->img);
+  }
@@ -4,6 +4,12 @@
 #include "Utils.h"
 #include <stdbool.h>
 
+  // enum mapping of the colour planes of a picture
+  enum RGB {RED, GREEN, BLUE};
+
+  // number of colour planes stored for every picture
+  #define NO_RGB_PLANES 3
+
   // The pixel struct is used to represent a pixel of an image in RGB format
   struct pixel {
     int red;
@@ -11,11 +17,20 @@
     int blue;
   };
 
+  // The storage used for the pixels of a picture, chosen when it is initialised
+  enum pixel_format {
+    FLOAT_PIXELS,   // sod image of [0,1] float intensities
+    BYTE_PIXELS     // planar 0-255 bytes (see create_image_bytes)
+  };
+
   // The picture struct provides a wrapper for image manipulation 
   // via the SOD library (https://sod.pixlab.io/intro.html)
   struct picture {    
-    // sod representation of an image
+    // sod representation of an image (FLOAT_PIXELS only)
     sod_img img;
+    // byte representation of an image (BYTE_PIXELS only)
+    unsigned char *bytes;
+    enum pixel_format format;
     int width;
     int height;
   };    
@@ -26,6 +41,17 @@
   // initialise picture struct of the specified size 
   bool init_picture_from_size(struct picture *pic, int width, int height); 
 
+  // as above, but with the pixels held in the given storage format
+  bool init_picture_from_file_as(struct picture *pic, const char *path, enum pixel_format format);
+  bool init_picture_from_size_as(struct picture *pic, int width, int height, enum pixel_format format);
+
+  // initialise picture struct as a copy of src, held in the given storage format
+  bool init_picture_from_copy(struct picture *pic, struct picture *src, enum pixel_format format);
+
+  // initialise picture struct of the specified size with random (synthetic) 
+  // pixels, drawn with sod_make_random_image and held in the given format
+  bool init_picture_from_random(struct picture *pic, int width, int height, enum pixel_format format);
+
   // save picture to specified file
   bool save_picture_to_file(struct picture *pic, const char *path);
 
@@ -35,6 +61,43 @@
   // set a single pixel in the image from a colour struct
   void set_pixel(struct picture *pic, int x, int y, struct pixel *rgb);
 
+  // Span access to the underlying image storage, for routines that walk the
+  // image a row at a time instead of going through get_pixel/set_pixel.
+  // The image is stored as NO_RGB_PLANES colour planes, one after the other,
+  // each holding height rows of width contiguous samples: [0,1] float 
+  // intensities for FLOAT_PIXELS pictures and 0-255 values for BYTE_PIXELS.
+
+  // distance (in samples) between the starts of two consecutive rows of a plane
+  int get_row_stride(struct picture *pic);
+
+  // distance (in samples) between the starts of two consecutive colour planes
+  int get_plane_stride(struct picture *pic);
+
+  // pointer to the first sample of row y in the given colour plane
+  float *get_row(struct picture *pic, int rgb, int y);
+  unsigned char *get_byte_row(struct picture *pic, int rgb, int y);
+
+  // Format-independent row access as 0-255 values. load_row returns the 
+  // row itself for BYTE_PIXELS pictures, or converts it into scratch (of at 
+  // least width bytes) for FLOAT_PIXELS pictures. store_row writes a row of 
+  // values back, and costs nothing for a row returned by load_row in place.
+  unsigned char *load_row(struct picture *pic, int rgb, int y, unsigned char *scratch);
+  void store_row(struct picture *pic, int rgb, int y, const unsigned char *row);
+
+  // copy the n values starting at (x,y) of a colour plane out to / in from values
+  void load_span(struct picture *pic, int rgb, int x, int y, int n, unsigned char *values);
+  void store_span(struct picture *pic, int rgb, int x, int y, int n, const unsigned char *values);
+
+  // how far apart two pictures of the same size are, over every 0-255 value
+  struct picture_diff {
+    int max_diff;       // largest absolute difference
+    double mse;         // mean squared difference
+    double psnr;        // peak signal-to-noise ratio in dB (INFINITY if equal)
+  };
+
+  // compare two pictures (of any formats) in memory; false if their sizes differ
+  bool compare_pictures(struct picture *a, struct picture *b, struct picture_diff *diff);
+
   // check if coordinates are within bounds of the stored image
   bool contains_point(struct picture *pic, int x, int y);
   
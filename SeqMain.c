@@ -4,6 +4,7 @@
 #include "Utils.h"
 #include "Picture.h"
 #include "PicProcess.h"
+#include "PicParallel.h"
 
   // list of all possible picture transformations
   static char *cmd_strings[] = { 
@@ -11,36 +12,162 @@
     "grayscale", 
     "rotate",
     "flip",
-    "blur"
+    "blur",
+    "convolve"
   };
 
 // -------------- picture transformation function wrappers -------------- \\
 
+  // (the parallel routines run the sequential ones unless --threads is given)
+
   void invert_picture_wrapper(struct picture *pic, const char *unused){
     printf("calling invert\n");
-    invert_picture(pic);
+    invert_picture_parallel(pic);
   }
 
   void grayscale_picture_wrapper(struct picture *pic, const char *unused){
     printf("calling grayscale\n");
-    grayscale_picture(pic);
+    grayscale_picture_parallel(pic);
+  }
+
+  // rotate, flip and convolve cannot run without their extra arg
+  static void require_arg(const char *process, const char *extra_arg){
+    if(extra_arg == NULL){
+      printf("[!] %s needs an extra arg\n", process);
+      exit(IO_ERROR);
+    }
   }
 
   void rotate_picture_wrapper(struct picture *pic, const char *extra_arg){
+    require_arg("rotate", extra_arg);
     int angle = atoi(extra_arg);
     printf("calling rotate (%i)\n", angle);
-    rotate_picture(pic, angle);
+    rotate_picture_parallel(pic, angle);
   }
 
   void flip_picture_wrapper(struct picture *pic, const char *extra_arg){
+    require_arg("flip", extra_arg);
     char plane = extra_arg[0];
     printf("calling flip (%c)\n", plane);
-    flip_picture(pic, plane);
+    flip_picture_parallel(pic, plane);
+  }
+
+  // number of passes asked for by blur's optional repeat count
+  static int blur_count(const char *extra_arg){
+    if(extra_arg == NULL){
+      return 1;
+    }
+    int times = atoi(extra_arg);
+    if(times < 1){
+      printf("[!] blur is undefined for %s passes (must be a positive number)\n", extra_arg);
+      exit(IO_ERROR);
+    }
+    return times;
+  }
+
+  void blur_picture_wrapper(struct picture *pic, const char *extra_arg){
+    // an optional repeat count runs several blurs in one sweep
+    if(extra_arg == NULL){
+      printf("calling blur\n");
+      blur_picture_parallel(pic);
+      return;
+    }
+    int times = blur_count(extra_arg);
+    printf("calling blur (%i)\n", times);
+    blur_picture_n_parallel(pic, times);
+  }
+
+  // kernels convolve knows by name
+  struct named_kernel {
+    const char *name;
+    int kw, kh;
+    int divisor;
+    int kernel[25];
+  };
+
+  static const struct named_kernel named_kernels[] = {
+    {"box", 3, 3, 9, {1, 1, 1, 1, 1, 1, 1, 1, 1}},
+    {"gaussian", 3, 3, 16, {1, 2, 1, 2, 4, 2, 1, 2, 1}},
+    {"gaussian5", 5, 5, 256, {1, 4, 6, 4, 1, 4, 16, 24, 16, 4, 6, 24, 36, 24, 6, 4, 16, 24, 16, 4, 1, 4, 6, 4, 1}},
+    {"sharpen", 3, 3, 1, {0, -1, 0, -1, 5, -1, 0, -1, 0}},
+    {"edge", 3, 3, 1, {-1, -1, -1, -1, 8, -1, -1, -1, -1}}
+  };
+
+  static const char *border_names[] = { "keep", "clamp", "zero" };
+
+  static int no_of_named_kernels = sizeof(named_kernels) / sizeof(named_kernels[0]);
+  static int no_of_border_names = sizeof(border_names) / sizeof(border_names[0]);
+
+  static void bad_kernel(const char *spec){
+    printf("[!] convolve is undefined for kernel %s (use a name or WxH/divisor/values..., optionally followed by @keep, @clamp or @zero)\n", spec);
+    exit(IO_ERROR);
+  }
+
+  // Read a kernel given as a name (see named_kernels) or as its size, 
+  // divisor and values, e.g. 3x3/16/1/2/1/2/4/2/1/2/1, either optionally 
+  // followed by a border mode such as @clamp (the default is @keep). The
+  // returned kernel values must be freed.
+  static int *parse_kernel(const char *spec, int *kw, int *kh, int *divisor, enum border_mode *border){
+    char *text = strdup(spec);
+    char *mode = strchr(text, '@');
+    *border = BORDER_KEEP;
+    if(mode != NULL){
+      *mode++ = '\0';
+      int b = 0;
+      while(b < no_of_border_names && strcmp(mode, border_names[b])){
+        b++;
+      }
+      if(b == no_of_border_names){
+        bad_kernel(spec);
+      }
+      *border = b;
+    }
+
+    int *kernel = NULL;
+    for(int k = 0; k < no_of_named_kernels; k++){
+      if(!strcmp(text, named_kernels[k].name)){
+        *kw = named_kernels[k].kw;
+        *kh = named_kernels[k].kh;
+        *divisor = named_kernels[k].divisor;
+        kernel = malloc(*kw * *kh * sizeof(int));
+        memcpy(kernel, named_kernels[k].kernel, *kw * *kh * sizeof(int));
+      }
+    }
+
+    if(kernel == NULL){
+      char *end;
+      *kw = strtol(text, &end, 10);
+      if(*end != 'x' || *kw < 1){
+        bad_kernel(spec);
+      }
+      *kh = strtol(end + 1, &end, 10);
+      if(*end != '/' || *kh < 1){
+        bad_kernel(spec);
+      }
+      *divisor = strtol(end + 1, &end, 10);
+      kernel = malloc(*kw * *kh * sizeof(int));
+      for(int i = 0; i < *kw * *kh; i++){
+        if(*end != '/'){
+          bad_kernel(spec);
+        }
+        kernel[i] = strtol(end + 1, &end, 10);
+      }
+      if(*end != '\0'){
+        bad_kernel(spec);
+      }
+    }
+    free(text);
+    return kernel;
   }
 
-  void blur_picture_wrapper(struct picture *pic, const char *unused){
-    printf("calling blur\n");
-    blur_picture(pic);
+  void convolve_picture_wrapper(struct picture *pic, const char *extra_arg){
+    require_arg("convolve", extra_arg);
+    int kw, kh, divisor;
+    enum border_mode border;
+    int *kernel = parse_kernel(extra_arg, &kw, &kh, &divisor, &border);
+    printf("calling convolve (%s)\n", extra_arg);
+    convolve_picture_parallel(pic, kernel, kw, kh, divisor, border);
+    free(kernel);
   }
 
 // ------------------------------------------------------------------------ \\
@@ -51,12 +178,125 @@
     grayscale_picture_wrapper,
     rotate_picture_wrapper,
     flip_picture_wrapper,
-    blur_picture_wrapper
+    blur_picture_wrapper,
+    convolve_picture_wrapper
   };
 
   // size of look-up table (for safe IO error reporting)
   static int no_of_cmds = sizeof(cmds) / sizeof(cmds[0]);
 
+  // one transformation of a comma separated process list such as 
+  // invert,rotate:90,blur (an argument follows its name after a colon)
+  struct step {
+    int cmd_no;
+    const char *extra_arg;
+  };
+
+  // split process into steps, checking every name; the list is modified
+  static int parse_steps(char *process, struct step *steps){
+    int no_of_steps = 0;
+    for(char *name = strtok(process, ","); name != NULL; name = strtok(NULL, ",")){
+      char *arg = strchr(name, ':');
+      if(arg != NULL){
+        *arg++ = '\0';
+      }
+      int cmd_no = 0;
+      while(cmd_no < no_of_cmds && strcmp(name, cmd_strings[cmd_no])){
+        cmd_no++;
+      }
+      if(cmd_no == no_of_cmds){
+        printf("[!] invalid process requested: %s is not defined\n    aborting...\n", name);  
+        exit(IO_ERROR);   
+      }
+      steps[no_of_steps++] = (struct step) { cmd_no, arg };
+    }
+    return no_of_steps;
+  }
+
+  // the pointwise operation a step performs, if it is a per-pixel one
+  static bool is_pointwise(struct step *step, enum pointwise_op *op){
+    if(cmds[step->cmd_no] == invert_picture_wrapper){
+      *op = INVERT_OP;
+      return true;
+    }
+    if(cmds[step->cmd_no] == grayscale_picture_wrapper){
+      *op = GRAYSCALE_OP;
+      return true;
+    }
+    return false;
+  }
+
+  // the geometry of a step, if it is a rotation or a flip
+  static bool is_geometric(struct step *step, struct geometry *geom){
+    if(cmds[step->cmd_no] == rotate_picture_wrapper){
+      require_arg("rotate", step->extra_arg);
+      *geom = rotate_geometry(atoi(step->extra_arg));
+      return true;
+    }
+    if(cmds[step->cmd_no] == flip_picture_wrapper){
+      require_arg("flip", step->extra_arg);
+      *geom = flip_geometry(step->extra_arg[0]);
+      return true;
+    }
+    return false;
+  }
+
+  // Run the steps in order. Runs of consecutive per-pixel steps are fused 
+  // into a single pass over the picture, runs of rotations and flips are 
+  // composed into a single remap (or skipped if they cancel out), and runs 
+  // of blurs into a single blur sweep; everything else goes through its
+  // wrapper.
+  static void run_steps(struct picture *pic, struct step *steps, int no_of_steps){
+    enum pointwise_op *ops = malloc(no_of_steps * sizeof(enum pointwise_op));
+    for(int i = 0; i < no_of_steps; ){
+      int no_of_ops = 0;
+      while(i + no_of_ops < no_of_steps && is_pointwise(&steps[i + no_of_ops], &ops[no_of_ops])){
+        no_of_ops++;
+      }
+      if(no_of_ops > 1){
+        printf("calling %i fused pointwise transformations\n", no_of_ops);
+        pointwise_picture_parallel(pic, ops, no_of_ops);
+        i += no_of_ops;
+        continue;
+      }
+
+      struct geometry geom = identity_geometry();
+      struct geometry next;
+      int j = i;
+      while(j < no_of_steps && is_geometric(&steps[j], &next)){
+        geom = compose_geometry(geom, next);
+        j++;
+      }
+      if(j - i > 1){
+        if(is_identity_geometry(geom)){
+          printf("skipping %i rotations and flips (they cancel out)\n", j - i);
+        } else {
+          printf("calling %i composed rotations and flips\n", j - i);
+          apply_geometry_parallel(pic, geom);
+        }
+        i = j;
+        continue;
+      }
+
+      int times = 0;
+      j = i;
+      while(j < no_of_steps && cmds[steps[j].cmd_no] == blur_picture_wrapper){
+        times += blur_count(steps[j].extra_arg);
+        j++;
+      }
+      if(j - i > 1){
+        printf("calling blur (%i)\n", times);
+        blur_picture_n_parallel(pic, times);
+        i = j;
+        continue;
+      }
+
+      cmds[steps[i].cmd_no](pic, steps[i].extra_arg);
+      i++;
+    }
+    free(ops);
+  }
+
 
 // ---------- MAIN PROGRAM ---------- \\
 
@@ -64,11 +304,31 @@
 
     printf("Running the C Picture Processor... \n");
 
+    // separate the optional --threads N and --stealing flags (accepted 
+    // anywhere) from the positional arguments
+    const char *args[4] = { NULL, NULL, NULL, NULL };
+    int no_of_args = 0;
+    int threads = 1;
+    enum worker_kind workers = POOL_WORKERS;
+    for(int i = 1; i < argc; i++){
+      if(!strcmp(argv[i], "--threads")){
+        if(i + 1 == argc || (threads = atoi(argv[i + 1])) < 1){
+          printf("[!] --threads must be followed by a positive number of threads\n");
+          exit(IO_ERROR);
+        }
+        i++;
+      } else if(!strcmp(argv[i], "--stealing")){
+        workers = STEALING_WORKERS;
+      } else if(no_of_args < 4){
+        args[no_of_args++] = argv[i];
+      }
+    }
+
     // capture and check command line arguments
-    const char * filename = argv[1];
-    const char * target_file = argv[2];
-    const char * process = argv[3];
-    const char * extra_arg = argv[4];
+    const char * filename = args[0];
+    const char * target_file = args[1];
+    const char * process = args[2];
+    const char * extra_arg = args[3];
     
     if(filename == NULL || target_file == NULL || process == NULL){
       printf("[!] insufficient command line arguments provided\n");
@@ -79,29 +339,42 @@
     printf("  target    = %s\n", target_file);
     printf("  process   = %s\n", process);
     printf("  extra arg = %s\n", extra_arg);
+    printf("  threads   = %i%s\n", threads, workers == STEALING_WORKERS ? " (work stealing)" : "");
   
     printf("\n");
   
-    // create original image object
+    // create original image object (held as bytes, as every transformation 
+    // works on 0-255 values)
     struct picture pic;
-    if(!init_picture_from_file(&pic, filename)){
+    if(!init_picture_from_file_as(&pic, filename, BYTE_PIXELS)){
       exit(IO_ERROR);   
     }    
   
-    // identify the picture transformation to run
-    int cmd_no = 0;
-    while(cmd_no < no_of_cmds && strcmp(process, cmd_strings[cmd_no])){
-      cmd_no++;
-    }
-  
+    // identify the picture transformation(s) to run
+    char *process_list = strdup(process);
+    struct step *steps = malloc((strlen(process) + 1) * sizeof(struct step));
+    int no_of_steps = parse_steps(process_list, steps);
+
     // IO error check
-    if(cmd_no == no_of_cmds){
+    if(no_of_steps == 0){
       printf("[!] invalid process requested: %s is not defined\n    aborting...\n", process);  
       exit(IO_ERROR);   
     }
+
+    // a separate extra arg belongs to a lone transformation
+    if(no_of_steps == 1 && steps[0].extra_arg == NULL){
+      steps[0].extra_arg = extra_arg;
+    } else if(extra_arg != NULL){
+      printf("[!] extra arg %s is ambiguous for a list of processes (use name:arg)\n", extra_arg);
+      exit(IO_ERROR);
+    }
   
-    // dispatch to appropriate picture transformation function
-    cmds[cmd_no](&pic, extra_arg);
+    // dispatch to appropriate picture transformation functions
+    init_workers_of(workers, threads);
+    run_steps(&pic, steps, no_of_steps);
+    clear_workers();
+    free(steps);
+    free(process_list);
 
     // save resulting picture and report success
     save_picture_to_file(&pic, target_file);
@@ -1,5 +1,7 @@
 #include "Utils.h"
+#include <string.h>
 #include <unistd.h>
+#include "sod_img_reader.h"
 
   #define DEFAULT_COMPRESSION_QUALITY -1
   #define FULL_COLOUR_CHANNELS 3
@@ -35,6 +37,70 @@
     return true;
   }
 
+  unsigned char *create_image_bytes(int width, int height){
+    return calloc((size_t) width * height * FULL_COLOUR_CHANNELS, sizeof(unsigned char));
+  }
+
+  void free_image_bytes(unsigned char *bytes){
+    free(bytes);
+  }
+
+  unsigned char *load_image_bytes(const char *path, int *width, int *height){
+    if( access(path, F_OK) == IO_ERROR ){
+      printf("[!] error reading from file %s (check it exists)\n", path);
+      return NULL;
+    }
+    int channels;
+    unsigned char *interleaved = stbi_load(path, width, height, &channels, FULL_COLOUR_CHANNELS);
+    if(interleaved == NULL){
+      printf("[!] unsupported image format (expecting jpeg, png or bmp)\n");
+      return NULL;
+    }
+    
+    // stb hands back RGBRGB... so split it into one plane per colour
+    unsigned char *bytes = create_image_bytes(*width, *height);
+    if(bytes != NULL){
+      size_t plane = (size_t) *width * *height;
+      for(int k = 0; k < FULL_COLOUR_CHANNELS; k++){
+        for(size_t i = 0; i < plane; i++){
+          bytes[k * plane + i] = interleaved[i * FULL_COLOUR_CHANNELS + k];
+        }
+      }
+    }
+    stbi_image_free(interleaved);
+    return bytes;
+  }
+
+  bool save_image_bytes(const unsigned char *bytes, int width, int height, const char *path){
+    size_t plane = (size_t) width * height;
+    unsigned char *interleaved = malloc(plane * FULL_COLOUR_CHANNELS);
+    if(interleaved == NULL){
+      printf("[!] error saving file to %s\n", path);
+      return false;
+    }
+    for(size_t i = 0; i < plane; i++){
+      for(int k = 0; k < FULL_COLOUR_CHANNELS; k++){
+        interleaved[i * FULL_COLOUR_CHANNELS + k] = bytes[k * plane + i];
+      }
+    }
+    int ret = sod_img_blob_save_as_jpeg(path, interleaved, width, height, FULL_COLOUR_CHANNELS, DEFAULT_COMPRESSION_QUALITY);
+    free(interleaved);
+    if(ret != SOD_OK){
+      printf("[!] error saving file to %s\n", path);
+      return false;
+    }
+    return true;
+  }
+
+  unsigned char *copy_image_bytes(const unsigned char *bytes, int width, int height){
+    size_t size = (size_t) width * height * FULL_COLOUR_CHANNELS;
+    unsigned char *copy = malloc(size);
+    if(copy != NULL){
+      memcpy(copy, bytes, size);
+    }
+    return copy;
+  }
+
   sod_img copy_image(sod_img img){
     return sod_copy_image(img);   
   }
@@ -49,11 +115,10 @@
 
   int get_pixel_value(sod_img img, int rgb, int x, int y){
     float intensity = sod_img_get_pixel(img, x, y, rgb);
-    int rgb_value =  intensity * MAX_PIXEL_INTENSITY;
-    return rgb_value;
+    return TO_RGB_VALUE(intensity);
   }
 
   void set_pixel_value(sod_img img, int rgb, int x, int y, int val){
-    float intensity = val / MAX_PIXEL_INTENSITY;  
+    float intensity = TO_INTENSITY(val);  
     sod_img_set_pixel(img, x, y, rgb, intensity);  
   }
@@ -8,6 +8,13 @@
 
   #define IO_ERROR -1
   #define MAX_PIXEL_INTENSITY 255.0
+  #define MAX_RGB_VALUE 255
+
+  // Convert between sod's [0,1] float intensities and 0-255 RGB values, 
+  // using the same truncation as get_pixel_value and set_pixel_value.
+  // These are macros so that they can be used inside vectorised row loops.
+  #define TO_RGB_VALUE(intensity) ((int) ((intensity) * MAX_PIXEL_INTENSITY))
+  #define TO_INTENSITY(val) ((float) ((val) / MAX_PIXEL_INTENSITY))
 
   // Create a new instance of a sod image of the specified width 
   // and height, using the full RGB colour model.
@@ -25,6 +32,26 @@
   // Clones the image provided as argument
   sod_img copy_image(sod_img img);
   
+  // Byte images hold the same pixels as a sod image, as 0-255 values rather 
+  // than [0,1] floats, in one width x height plane per colour channel. They 
+  // are read and written without any float conversion and use 4x less memory.
+
+  // Create a new (zeroed) byte image of the specified width and height.
+  unsigned char *create_image_bytes(int width, int height);
+
+  // Free the memory used by the byte image provided as argument
+  void free_image_bytes(unsigned char *bytes);
+
+  // Create a byte image from the image file at the specified location,
+  // reporting its dimensions through width and height.
+  unsigned char *load_image_bytes(const char *path, int *width, int *height);
+
+  // Saves the given byte image in the given destination.
+  bool save_image_bytes(const unsigned char *bytes, int width, int height, const char *path);
+
+  // Clones the byte image provided as argument
+  unsigned char *copy_image_bytes(const unsigned char *bytes, int width, int height);
+
   // Find the width of the provided image
   int get_image_width(sod_img img);
   
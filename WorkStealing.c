@@ -0,0 +1,270 @@
+#include "WorkStealing.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+  // a deque only ever holds ranges of strictly decreasing size (each push 
+  // is half of the range just popped), so it never holds more than one 
+  // range per bit of an int
+  #define DEQUE_SIZE 64
+
+  // with an adaptive grain, loops are cut into about this many ranges per
+  // thread, which is plenty for stealing to even out the load
+  #define RANGES_PER_THREAD 8
+
+  // failed steal attempts before an idle worker yields the processor
+  #define STEAL_SPINS 64
+
+  #define CACHE_LINE 64
+
+  // Chase-Lev deque (with the memory orders of Le et al., "Correct and 
+  // efficient work-stealing for weak memory models") over a fixed ring of 
+  // ranges, each packed into one 64-bit word: the owner pushes and takes at
+  // the bottom, thieves steal from the top
+  struct deque {
+    _Alignas(CACHE_LINE) atomic_long top;
+    _Alignas(CACHE_LINE) atomic_long bottom;
+    atomic_uint_least64_t ranges[DEQUE_SIZE];
+  };
+
+  struct worker {
+    struct deque deque;
+    struct stealing_pool *pool;
+    int index;
+    unsigned int seed;      // for picking victims
+  };
+
+  struct stealing_pool {
+    int size;
+    struct worker *workers;
+    pthread_t *threads;
+
+    // the workers sleep on wake until the generation changes
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    unsigned int generation;
+    bool stopping;
+
+    // the current loop: indices not yet done, and what to do with them
+    _Alignas(CACHE_LINE) atomic_long remaining;
+    range_func fn;
+    void *ctx;
+    int grain;
+  };
+
+  static uint64_t pack_range(int begin, int end){
+    return (uint64_t) (uint32_t) begin << 32 | (uint32_t) end;
+  }
+
+  static void unpack_range(uint64_t range, int *begin, int *end){
+    *begin = (int) (uint32_t) (range >> 32);
+    *end = (int) (uint32_t) range;
+  }
+
+// ------------------------------- deques ------------------------------- \\
+
+  static bool push_bottom(struct deque *d, uint64_t range){
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if(b - t >= DEQUE_SIZE){
+      return false;
+    }
+    atomic_store_explicit(&d->ranges[b % DEQUE_SIZE], range, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return true;
+  }
+
+  static bool take_bottom(struct deque *d, uint64_t *range){
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if(t > b){
+      atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+      return false;
+    }
+    *range = atomic_load_explicit(&d->ranges[b % DEQUE_SIZE], memory_order_relaxed);
+    if(t < b){
+      return true;
+    }
+    // the last range: race the thieves for it
+    bool won = atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, 
+                 memory_order_seq_cst, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return won;
+  }
+
+  static bool steal_top(struct deque *d, uint64_t *range){
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if(t >= b){
+      return false;
+    }
+    *range = atomic_load_explicit(&d->ranges[t % DEQUE_SIZE], memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, 
+             memory_order_seq_cst, memory_order_relaxed);
+  }
+
+// ----------------------------- scheduling ----------------------------- \\
+
+  // try every other worker once, starting from a random one
+  static bool steal(struct worker *self, uint64_t *range){
+    struct stealing_pool *pool = self->pool;
+    if(pool->size < 2){
+      return false;
+    }
+    int start = rand_r(&self->seed) % pool->size;
+    for(int i = 0; i < pool->size; i++){
+      struct worker *victim = &pool->workers[(start + i) % pool->size];
+      if(victim != self && steal_top(&victim->deque, range)){
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // split the range, keeping the lower halves, until it is small enough 
+  // to run (or the deque is full)
+  static void run_range(struct worker *self, uint64_t range){
+    struct stealing_pool *pool = self->pool;
+    int begin, end;
+    unpack_range(range, &begin, &end);
+    while(end - begin > pool->grain){
+      int middle = begin + (end - begin) / 2;
+      if(!push_bottom(&self->deque, pack_range(middle, end))){
+        break;
+      }
+      end = middle;
+    }
+    pool->fn(pool->ctx, begin, end);
+    atomic_fetch_sub_explicit(&pool->remaining, end - begin, memory_order_acq_rel);
+  }
+
+  static void work_until_done(struct worker *self){
+    struct stealing_pool *pool = self->pool;
+    int failures = 0;
+    while(atomic_load_explicit(&pool->remaining, memory_order_acquire) > 0){
+      uint64_t range;
+      if(take_bottom(&self->deque, &range) || steal(self, &range)){
+        run_range(self, range);
+        failures = 0;
+      } else if(++failures >= STEAL_SPINS){
+        sched_yield();
+        failures = 0;
+      }
+    }
+  }
+
+  static void *worker_thread(void *arg){
+    struct worker *self = arg;
+    struct stealing_pool *pool = self->pool;
+    unsigned int seen = 0;
+    while(true){
+      pthread_mutex_lock(&pool->lock);
+      while(pool->generation == seen && !pool->stopping){
+        pthread_cond_wait(&pool->wake, &pool->lock);
+      }
+      seen = pool->generation;
+      bool stopping = pool->stopping;
+      pthread_mutex_unlock(&pool->lock);
+      if(stopping){
+        return NULL;
+      }
+      work_until_done(self);
+    }
+  }
+
+// ------------------------------ interface ------------------------------ \\
+
+  struct stealing_pool *stealing_pool_init(int threads){
+    struct stealing_pool *pool = calloc(1, sizeof(struct stealing_pool));
+    if(pool == NULL){
+      return NULL;
+    }
+    pool->size = threads < 1 ? 1 : threads;
+    pool->workers = aligned_alloc(CACHE_LINE, pool->size * sizeof(struct worker));
+    pool->threads = malloc(pool->size * sizeof(pthread_t));
+    if(pool->workers == NULL || pool->threads == NULL){
+      free(pool->workers);
+      free(pool->threads);
+      free(pool);
+      return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    atomic_init(&pool->remaining, 0);
+
+    for(int w = 0; w < pool->size; w++){
+      struct worker *worker = &pool->workers[w];
+      atomic_init(&worker->deque.top, 0);
+      atomic_init(&worker->deque.bottom, 0);
+      worker->pool = pool;
+      worker->index = w;
+      worker->seed = w + 1;
+    }
+    // worker 0 is whichever thread runs the loops
+    for(int w = 1; w < pool->size; w++){
+      if(pthread_create(&pool->threads[w], NULL, worker_thread, &pool->workers[w]) != 0){
+        pool->size = w;
+        stealing_pool_destroy(pool);
+        return NULL;
+      }
+    }
+    return pool;
+  }
+
+  void stealing_pool_destroy(struct stealing_pool *pool){
+    if(pool == NULL){
+      return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for(int w = 1; w < pool->size; w++){
+      pthread_join(pool->threads[w], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->workers);
+    free(pool->threads);
+    free(pool);
+  }
+
+  int stealing_pool_size(struct stealing_pool *pool){
+    return pool->size;
+  }
+
+  void stealing_parallel_for(struct stealing_pool *pool, int begin, int end, int grain, range_func fn, void *ctx){
+    if(end <= begin){
+      return;
+    }
+    if(grain <= 0){
+      grain = (end - begin) / (RANGES_PER_THREAD * pool->size);
+    }
+    if(pool->size == 1){
+      fn(ctx, begin, end);
+      return;
+    }
+
+    // the loop is set up before its first range is published (by the 
+    // release in push_bottom or the mutex), and a worker only uses it 
+    // once it holds a range
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->grain = grain < 1 ? 1 : grain;
+    atomic_store_explicit(&pool->remaining, end - begin, memory_order_release);
+    push_bottom(&pool->workers[0].deque, pack_range(begin, end));
+
+    pthread_mutex_lock(&pool->lock);
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    work_until_done(&pool->workers[0]);
+  }
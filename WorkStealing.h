@@ -0,0 +1,28 @@
+#ifndef WORKSTEALING_H
+#define WORKSTEALING_H
+
+  // A work-stealing scheduler for data parallel loops. Every worker keeps its
+  // own Chase-Lev deque of index ranges: it splits the range it is working 
+  // on in half, pushing the upper half, until the range is no bigger than 
+  // the grain, while idle workers steal the biggest ranges left from the 
+  // others. No lock is taken while there is work to do, so the work can be
+  // cut much finer than with a shared task queue.
+
+  struct stealing_pool;
+
+  // called with the ranges [begin, end) the loop is cut into
+  typedef void (*range_func)(void *ctx, int begin, int end);
+
+  // start a scheduler with the given number of threads, one of which is 
+  // always the thread calling stealing_parallel_for (so 1 runs everything
+  // on the caller); NULL if the threads could not be started
+  struct stealing_pool *stealing_pool_init(int threads);
+  void stealing_pool_destroy(struct stealing_pool *pool);
+  int stealing_pool_size(struct stealing_pool *pool);
+
+  // call fn on ranges covering [begin, end) in parallel, returning when 
+  // they are all done; ranges are cut down to at most grain indices, or to
+  // an adaptive grain (a few ranges per thread) when grain <= 0
+  void stealing_parallel_for(struct stealing_pool *pool, int begin, int end, int grain, range_func fn, void *ctx);
+
+#endif
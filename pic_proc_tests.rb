@@ -103,6 +103,35 @@ else
   for blur_cnt in 2..10
     run_test("repeated blur test #{blur_cnt}", "need_glasses#{blur_cnt-1}.jpg need_glasses#{blur_cnt}.jpg blur", "need_glasses#{blur_cnt}.jpeg")  
   end
+  run_test("blur count test 1", "test_images/test.jpg test_blur.jpg blur 1", "test_blur.jpeg")
+  run_test("blur count test 2", "test_images/test.jpg test_blur_3.jpg blur 3", "test_blur_3.jpeg")
+
+  run_test("threaded invert test", "test_images/me.jpg rave.jpg invert --threads 4", "rave.jpeg")
+  run_test("threaded grayscale test", "test_images/me.jpg classic.jpg grayscale --threads 4", "classic.jpeg")
+  run_test("threaded rotate 90 test", "test_images/test.jpg test_rotate_90.jpg rotate 90 --threads 4", "test_rotate_90.jpeg")
+  run_test("threaded rotate 180 test", "test_images/test.jpg test_rotate_180.jpg rotate 180 --threads 4", "test_rotate_180.jpeg")
+  run_test("threaded rotate 270 test", "test_images/test.jpg test_rotate_270.jpg rotate 270 --threads 4", "test_rotate_270.jpeg")
+  run_test("threaded flip H test", "test_images/keep_calm.jpg keep_calm_H.jpg flip H --threads 4", "keep_calm_H.jpeg")
+  run_test("threaded flip V test", "test_images/keep_calm.jpg keep_calm_V.jpg flip V --threads 4", "keep_calm_V.jpeg")
+  run_test("threaded blur test", "test_images/dip.jpg blip.jpg blur --threads 4", "blip.jpeg")
+  run_test("threaded blur count test", "test_images/test.jpg test_blur_3.jpg blur 3 --threads 4", "test_blur_3.jpeg")
+  run_test("work stealing invert test", "test_images/me.jpg rave.jpg invert --threads 4 --stealing", "rave.jpeg")
+  run_test("work stealing rotate 90 test", "test_images/test.jpg test_rotate_90.jpg rotate 90 --threads 4 --stealing", "test_rotate_90.jpeg")
+  run_test("work stealing blur count test", "test_images/test.jpg test_blur_3.jpg blur 3 --threads 4 --stealing", "test_blur_3.jpeg")
+
+  run_test("process list test 1", "test_images/test.jpg test_invert_grayscale_blur_2.jpg invert,grayscale,blur,blur", "test_invert_grayscale_blur_2.jpeg")
+  run_test("process list test 2", "test_images/test.jpg test_rotate_90.jpg rotate:90", "test_rotate_90.jpeg")
+  run_test("process list test 3", "test_images/test.jpg test_invert_grayscale_blur_2.jpg invert,grayscale,blur:2 --threads 4", "test_invert_grayscale_blur_2.jpeg")
+
+  run_test("geometry list test 1", "test_images/test.jpg test_rotate_180.jpg flip:H,flip:V", "test_rotate_180.jpeg")
+  run_test("geometry list test 2", "test_images/test.jpg test_rotate_270.jpg rotate:90,rotate:180", "test_rotate_270.jpeg")
+  run_test("geometry list test 3", "test_images/test.jpg test_flip_V.jpg rotate:90,rotate:90,rotate:90,rotate:90,flip:V", "test_flip_V.jpeg")
+  run_test("geometry list test 4", "test_images/keep_calm.jpg keep_calm_V.jpg rotate:90,flip:V,rotate:90 --threads 4", "keep_calm_V.jpeg")
+
+  run_test("convolve test 1", "test_images/test.jpg test_blur.jpg convolve box", "test_blur.jpeg")
+  run_test("convolve test 2", "test_images/dip.jpg blip.jpg convolve 3x3/9/1/1/1/1/1/1/1/1/1 --threads 4", "blip.jpeg")
+  run_test("convolve test 3", "test_images/test.jpg test_gaussian5_clamp.jpg convolve gaussian5@clamp", "test_gaussian5_clamp.jpeg")
+  run_test("convolve test 4", "test_images/test.jpg test_gaussian5_clamp.jpg convolve gaussian5@clamp --threads 4", "test_gaussian5_clamp.jpeg")
   
   puts "----------------------------------------"
   puts "           IO ERROR Test Cases          " 
@@ -123,6 +152,20 @@ else
   
   run_test("flip arg error test", "test_images/test.jpg output.jpg flip O", nil, false)
   
+  run_test("blur arg error test", "test_images/test.jpg output.jpg blur 0", nil, false)
+
+  run_test("process list error test 1", "test_images/test.jpg output.jpg invert,blar", nil, false)
+  run_test("process list error test 2", "test_images/test.jpg output.jpg invert,rotate 90", nil, false)
+  run_test("process list error test 3", "test_images/test.jpg output.jpg rotate", nil, false)
+
+  run_test("convolve arg error test 1", "test_images/test.jpg output.jpg convolve", nil, false)
+  run_test("convolve arg error test 2", "test_images/test.jpg output.jpg convolve blar", nil, false)
+  run_test("convolve arg error test 3", "test_images/test.jpg output.jpg convolve 2x2/4/1/1/1/1", nil, false)
+  run_test("convolve arg error test 4", "test_images/test.jpg output.jpg convolve 3x3/0/1/1/1/1/1/1/1/1/1", nil, false)
+
+  run_test("threads arg error test 1", "test_images/test.jpg output.jpg invert --threads 0", nil, false)
+  run_test("threads arg error test 2", "test_images/test.jpg output.jpg invert --threads", nil, false)
+  
   # clean up the files generated by the tests
   system %Q(make clean)
 end
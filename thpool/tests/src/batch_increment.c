@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdlib.h>
+#include "../../thpool.h"
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+int sum=0;
+
+
+void add(void* arg) {
+	pthread_mutex_lock(&mutex);
+	sum += *(int*)arg;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+int main(int argc, char *argv[]){
+
+	char* p;
+	if (argc != 3){
+		puts("This testfile needs excactly two arguments");
+		exit(1);
+	}
+	int num_jobs    = strtol(argv[1], &p, 10);
+	int num_threads = strtol(argv[2], &p, 10);
+
+	threadpool thpool = thpool_init(num_threads);
+
+	/* every job adds one, handed to the pool in batches of up to 1000 */
+	int one = 1;
+	void** args = malloc(1000 * sizeof(void*));
+	int n;
+	for (n=0; n<1000; n++){
+		args[n] = &one;
+	}
+	for (n=0; n<num_jobs; n+=1000){
+		thpool_add_work_batch(thpool, add, args, num_jobs - n < 1000 ? num_jobs - n : 1000);
+	}
+
+	thpool_wait(thpool);
+
+	printf("%d\n", sum);
+
+	free(args);
+	return 0;
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "../../thpool.h"
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+int sum=0;
+threadpool thpool;
+
+
+/* Jobs of depth > 0 add two jobs of depth - 1 from inside the pool, so
+ * these go on the adding thread's own deque and get stolen from there */
+void fan_out(void* arg) {
+	intptr_t depth = (intptr_t)arg;
+	if (depth == 0){
+		pthread_mutex_lock(&mutex);
+		sum ++;
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+	void* args[2] = {(void*)(depth - 1), (void*)(depth - 1)};
+	thpool_add_work_batch(thpool, fan_out, args, 2);
+}
+
+
+int main(int argc, char *argv[]){
+
+	char* p;
+	if (argc != 3){
+		puts("This testfile needs excactly two arguments");
+		exit(1);
+	}
+	int depth       = strtol(argv[1], &p, 10);
+	int num_threads = strtol(argv[2], &p, 10);
+
+	thpool = thpool_init(num_threads);
+
+	thpool_add_work(thpool, fan_out, (void*)(intptr_t)depth);
+
+	thpool_wait(thpool);
+
+	printf("%d\n", sum);
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdlib.h>
+#include "../../thpool.h"
+
+int* hits;
+
+
+void hit(void* ctx, int begin, int end) {
+	(void)ctx;
+	int i;
+	for (i=begin; i<end; i++){
+		hits[i]++;
+	}
+}
+
+
+int main(int argc, char *argv[]){
+
+	char* p;
+	if (argc != 4){
+		puts("This testfile needs excactly three arguments");
+		exit(1);
+	}
+	int num_indices = strtol(argv[1], &p, 10);
+	int num_threads = strtol(argv[2], &p, 10);
+	int grain       = strtol(argv[3], &p, 10);
+
+	threadpool thpool = thpool_init(num_threads);
+	hits = calloc(num_indices, sizeof(int));
+
+	/* every index must be visited exactly once by the time the loop returns */
+	thpool_parallel_for(thpool, 0, num_indices, grain, hit, NULL);
+
+	int visited = 0;
+	int i;
+	for (i=0; i<num_indices; i++){
+		visited += hits[i] == 1;
+	}
+	printf("%d\n", visited);
+
+	free(hits);
+	return 0;
+}
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "../../thpool.h"
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+int sum_a=0;
+int sum_b=0;
+
+
+void increment(void* sum) {
+	pthread_mutex_lock(&mutex);
+	(*(int*)sum) ++;
+	pthread_mutex_unlock(&mutex);
+}
+
+
+void add_jobs(threadpool thpool, int* sum, int num_jobs){
+	int n;
+	for (n=0; n<num_jobs; n++){
+		thpool_add_work(thpool, increment, sum);
+	}
+}
+
+
+int main(int argc, char *argv[]){
+
+	char* p;
+	if (argc != 3){
+		puts("This testfile needs excactly two arguments");
+		exit(1);
+	}
+	int num_jobs    = strtol(argv[1], &p, 10);
+	int num_threads = strtol(argv[2], &p, 10);
+
+	threadpool thpool_a = thpool_init(num_threads);
+	threadpool thpool_b = thpool_init(num_threads);
+
+	/* Pausing one pool must leave the other one working */
+	thpool_pause(thpool_a);
+	add_jobs(thpool_a, &sum_a, num_jobs);
+	add_jobs(thpool_b, &sum_b, num_jobs);
+	thpool_wait(thpool_b);
+	if (sum_a != 0){
+		printf("Paused pool ran %d jobs\n", sum_a);
+		return -1;
+	}
+	thpool_resume(thpool_a);
+	thpool_wait(thpool_a);
+
+	/* Destroying one pool must leave the other one working */
+	thpool_destroy(thpool_b);
+	add_jobs(thpool_a, &sum_a, num_jobs);
+	thpool_wait(thpool_a);
+
+	printf("%d\n", sum_a + sum_b);
+
+	thpool_destroy(thpool_a);
+	return 0;
+}
@@ -21,9 +21,70 @@ function test_mass_addition { #endsum #threads
 }
 
 
+function test_batch_addition { #endsum #threads
+	echo "Adding up to $1 in batches with $2 threads"
+	compile src/batch_increment.c
+	output=$(./test $1 $2)
+	num=$(echo $output | awk '{print $(NF)}')
+	if [ "$num" == "$1" ]; then
+		return
+	fi
+	err "Expected $1 but got $output" "$output"
+	exit 1
+}
+
+
+function test_parallel_for { #indices #threads #grain
+	echo "Visiting $1 indices in chunks of $3 with $2 threads"
+	compile src/parallel_for.c
+	output=$(./test $1 $2 $3)
+	num=$(echo $output | awk '{print $(NF)}')
+	if [ "$num" == "$1" ]; then
+		return
+	fi
+	err "Expected $1 visited once but got $output" "$output"
+	exit 1
+}
+
+
+function test_nested_addition { #depth #threads
+	echo "Adding up to 2^$1 with jobs adding jobs with $2 threads"
+	compile src/nested_increment.c
+	output=$(./test $1 $2)
+	num=$(echo $output | awk '{print $(NF)}')
+	if [ "$num" == "$((1 << $1))" ]; then
+		return
+	fi
+	err "Expected $((1 << $1)) but got $output" "$output"
+	exit 1
+}
+
+function test_two_pools { #jobs #threads
+	echo "Running $1 jobs on each of two pools with $2 threads, pausing one and destroying the other"
+	compile src/two_pools.c
+	output=$(./test $1 $2)
+	num=$(echo $output | awk '{print $(NF)}')
+	if [ "$num" == "$((3 * $1))" ]; then
+		return
+	fi
+	err "Expected $((3 * $1)) but got $output" "$output"
+	exit 1
+}
+
 # Run tests
 test_mass_addition 100 4
 test_mass_addition 100 1000
 test_mass_addition 100000 1000
+test_batch_addition 100 4
+test_batch_addition 100000 1000
+test_nested_addition 10 1
+test_nested_addition 16 4
+test_nested_addition 16 100
+test_two_pools 1000 4
+test_two_pools 100 1
+test_parallel_for 1 4 0
+test_parallel_for 100000 4 0
+test_parallel_for 100000 1000 7
+test_parallel_for 100000 0 1
 
 echo "No errors"
@@ -9,6 +9,7 @@
  ********************************/
 
 #define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
 #include <unistd.h>
 #include <signal.h>
 #include <stdio.h>
@@ -16,8 +17,13 @@
 #include <pthread.h>
 #include <errno.h>
 #include <time.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <limits.h>
 #if defined(__linux__)
 #include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #endif
 
 #include "thpool.h"
@@ -34,55 +40,158 @@
 #define err(str)
 #endif
 
-static volatile int threads_keepalive;
-static volatile int threads_on_hold;
+/* Number of job slots in the queue; must be a power of two */
+#ifndef THPOOL_QUEUE_SIZE
+#define THPOOL_QUEUE_SIZE 4096
+#endif
+#if (THPOOL_QUEUE_SIZE & (THPOOL_QUEUE_SIZE - 1)) != 0 || THPOOL_QUEUE_SIZE < 2
+#error "THPOOL_QUEUE_SIZE must be a power of two"
+#endif
+
+/* Number of jobs each thread's own deque holds; must be a power of two */
+#ifndef THPOOL_DEQUE_SIZE
+#define THPOOL_DEQUE_SIZE 256
+#endif
+#if (THPOOL_DEQUE_SIZE & (THPOOL_DEQUE_SIZE - 1)) != 0
+#error "THPOOL_DEQUE_SIZE must be a power of two"
+#endif
+
+/* Keeps the queue's push and pull counters on separate cache lines */
+#define THPOOL_CACHE_LINE 64
+
+/* Most times a waiting thread checks for a post before it sleeps (no
+ * spinning at all on a single processor) */
+#ifndef THPOOL_MAX_SPINS
+#define THPOOL_MAX_SPINS 1000
+#endif
+
+/* Tells the processor we are spinning */
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield")
+#else
+#define cpu_relax()
+#endif
+
+/* The pool thread the caller is, if any */
+static _Thread_local struct thread* this_thread;
 
 
 
 /* ========================== STRUCTURES ============================ */
 
 
-/* Binary semaphore */
-typedef struct bsem {
-	pthread_mutex_t mutex;
-	pthread_cond_t   cond;
-	int v;
-} bsem;
+/* Counting semaphore
+ *
+ * A waiting thread spins for a while, adapting how long to how long recent
+ * waits spun, and then sleeps on count with a futex. Posting only makes a
+ * system call when a thread is asleep.
+ */
+typedef struct csem {
+	atomic_int count;                    /* posts not yet taken       */
+	atomic_int waiters;                  /* threads asleep on count   */
+	atomic_int spins;                    /* running average of spins  */
+	int        max_spins;                /* upper bound on spinning   */
+} csem;
 
 
 /* Job */
 typedef struct job{
-	struct job*  prev;                   /* pointer to previous job   */
 	void   (*function)(void* arg);       /* function pointer          */
 	void*  arg;                          /* function's argument       */
 } job;
 
 
-/* Job queue */
+/* Job queue slot */
+typedef struct jobslot{
+	atomic_size_t sequence;              /* lap the slot is on        */
+	job  job;                            /* job stored in the slot    */
+} jobslot;
+
+
+/* Job queue
+ *
+ * A bounded lock-free ring of slots that any thread may push to or pull
+ * from (Vyukov's MPMC queue). A slot whose sequence equals a position is
+ * free for the push at that position; one whose sequence is position + 1
+ * holds the job for the pull at that position. Pushes and pulls claim their
+ * position with a compare-and-swap on rear and front respectively.
+ */
 typedef struct jobqueue{
-	pthread_mutex_t rwmutex;             /* used for queue r/w access */
-	job  *front;                         /* pointer to front of queue */
-	job  *rear;                          /* pointer to rear  of queue */
-	bsem *has_jobs;                      /* flag as binary semaphore  */
-	int   len;                           /* number of jobs in queue   */
+	jobslot *slots;                      /* ring of job slots         */
+	size_t   mask;                       /* number of slots - 1       */
+	char     pad0[THPOOL_CACHE_LINE];
+	atomic_size_t rear;                  /* next position to push to  */
+	char     pad1[THPOOL_CACHE_LINE];
+	atomic_size_t front;                 /* next position to pull from*/
+	char     pad2[THPOOL_CACHE_LINE];
+	csem has_jobs;                       /* posted for threads to wake*/
+	csem has_space;                      /* queue drained to half full*/
+	atomic_int len;                      /* number of jobs in queue   */
+	atomic_int num_pushers_waiting;      /* pushers waiting for space */
 } jobqueue;
 
 
+/* Range shared out by thpool_parallel_for */
+typedef struct range{
+	void   (*function)(void* ctx, int begin, int end);
+	void*  ctx;                          /* function's first argument */
+	int    begin;                        /* start of the range        */
+	int    end;                          /* end of the range          */
+	int    grain;                        /* indices per chunk         */
+	int    chunks;                       /* chunks the range is cut in*/
+	atomic_int next_chunk;               /* next chunk to run         */
+	atomic_int chunks_done;              /* chunks finished           */
+	atomic_int refs;                     /* caller + helpers using it */
+	csem   done;                         /* posted on the last chunk  */
+	void*  helpers[];                    /* args of the helper jobs   */
+} range;
+
+
+/* Deque slot */
+typedef struct dequeslot{
+	_Atomic(void (*)(void*)) function;   /* function pointer          */
+	_Atomic(void*) arg;                  /* function's argument       */
+} dequeslot;
+
+
+/* Deque of jobs added by its thread
+ *
+ * A Chase-Lev deque over a fixed ring (with the memory orders of Le et al.):
+ * the owning thread pushes and pops at the bottom, so it runs the jobs it
+ * added newest first, while idle threads steal the oldest from the top.
+ */
+typedef struct deque{
+	atomic_long top;                     /* next job to steal         */
+	char      pad0[THPOOL_CACHE_LINE];
+	atomic_long bottom;                  /* next slot to push to      */
+	char      pad1[THPOOL_CACHE_LINE];
+	dequeslot slots[THPOOL_DEQUE_SIZE];  /* ring of job slots         */
+} deque;
+
+
 /* Thread */
 typedef struct thread{
 	int       id;                        /* friendly id               */
 	pthread_t pthread;                   /* pointer to actual thread  */
 	struct thpool_* thpool_p;            /* access to thpool          */
+	unsigned int seed;                   /* for picking steal victims */
+	deque     deque;                     /* jobs added by this thread */
 } thread;
 
 
 /* Threadpool */
 typedef struct thpool_{
 	thread**   threads;                  /* pointer to threads        */
-	volatile int num_threads_alive;      /* threads currently alive   */
-	volatile int num_threads_working;    /* threads currently working */
-	pthread_mutex_t  thcount_lock;       /* used for thread count etc */
-	pthread_cond_t  threads_all_idle;    /* signal to thpool_wait     */
+	int        num_threads;              /* threads in the pool       */
+	volatile int threads_keepalive;      /* cleared to end the threads*/
+	volatile int threads_on_hold;        /* set while pool is paused  */
+	atomic_int num_threads_alive;        /* threads currently alive   */
+	atomic_int num_threads_working;      /* threads currently working */
+	atomic_int num_jobs_pending;         /* jobs added and not done   */
+	atomic_int num_waiting;              /* callers in thpool_wait    */
+	int        max_spins;                /* see csem                  */
 	jobqueue  jobqueue;                  /* job queue                 */
 } thpool_;
 
@@ -97,18 +206,35 @@ static int  thread_init(thpool_* thpool_p, struct thread** thread_p, int id);
 static void* thread_do(struct thread* thread_p);
 static void  thread_hold(int sig_id);
 static void  thread_destroy(struct thread* thread_p);
+static int   thread_next_job(struct thread* thread_p, struct job* job_p);
+static int   thread_steal(struct thread* thread_p, struct job* job_p);
+
+static void  thpool_jobs_done(thpool_* thpool_p, int n);
 
-static int   jobqueue_init(jobqueue* jobqueue_p);
+static int   jobqueue_init(jobqueue* jobqueue_p, int max_spins);
 static void  jobqueue_clear(jobqueue* jobqueue_p);
-static void  jobqueue_push(jobqueue* jobqueue_p, struct job* newjob_p);
-static struct job* jobqueue_pull(jobqueue* jobqueue_p);
+static int   jobqueue_push(jobqueue* jobqueue_p, void (*function_p)(void*), void** args_p, int n);
+static int   jobqueue_pull(jobqueue* jobqueue_p, struct job* job_p);
+static void  jobqueue_wake(jobqueue* jobqueue_p);
 static void  jobqueue_destroy(jobqueue* jobqueue_p);
 
-static void  bsem_init(struct bsem *bsem_p, int value);
-static void  bsem_reset(struct bsem *bsem_p);
-static void  bsem_post(struct bsem *bsem_p);
-static void  bsem_post_all(struct bsem *bsem_p);
-static void  bsem_wait(struct bsem *bsem_p);
+static void  deque_init(deque* deque_p);
+static int   deque_push(deque* deque_p, void (*function_p)(void*), void** args_p, int n);
+static int   deque_pop(deque* deque_p, struct job* job_p);
+static int   deque_steal(deque* deque_p, struct job* job_p);
+
+static void  range_run(struct range* range_p);
+static void  range_help(void* arg);
+static void  range_release(struct range* range_p);
+
+static void  futex_wait(atomic_int* addr, int value);
+static void  futex_wake(atomic_int* addr, int n);
+
+static void  csem_init(struct csem *csem_p, int value, int max_spins);
+static void  csem_post(struct csem *csem_p, int n);
+static void  csem_post_upto(struct csem *csem_p, int n);
+static int   csem_trywait(struct csem *csem_p);
+static void  csem_wait(struct csem *csem_p);
 
 
 
@@ -120,9 +246,6 @@ static void  bsem_wait(struct bsem *bsem_p);
 /* Initialise thread pool */
 struct thpool_* thpool_init(int num_threads){
 
-	threads_on_hold   = 0;
-	threads_keepalive = 1;
-
 	if (num_threads < 0){
 		num_threads = 0;
 	}
@@ -134,11 +257,19 @@ struct thpool_* thpool_init(int num_threads){
 		err("thpool_init(): Could not allocate memory for thread pool\n");
 		return NULL;
 	}
-	thpool_p->num_threads_alive   = 0;
-	thpool_p->num_threads_working = 0;
+	thpool_p->num_threads         = num_threads;
+	thpool_p->threads_keepalive   = 1;
+	thpool_p->threads_on_hold     = 0;
+	atomic_init(&thpool_p->num_threads_alive, 0);
+	atomic_init(&thpool_p->num_threads_working, 0);
+	atomic_init(&thpool_p->num_jobs_pending, 0);
+	atomic_init(&thpool_p->num_waiting, 0);
+
+	/* Spinning only pays off when the thread that posts can run meanwhile */
+	thpool_p->max_spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? THPOOL_MAX_SPINS : 0;
 
 	/* Initialise the job queue */
-	if (jobqueue_init(&thpool_p->jobqueue) == -1){
+	if (jobqueue_init(&thpool_p->jobqueue, thpool_p->max_spins) == -1){
 		err("thpool_init(): Could not allocate memory for job queue\n");
 		free(thpool_p);
 		return NULL;
@@ -153,9 +284,6 @@ struct thpool_* thpool_init(int num_threads){
 		return NULL;
 	}
 
-	pthread_mutex_init(&(thpool_p->thcount_lock), NULL);
-	pthread_cond_init(&thpool_p->threads_all_idle, NULL);
-
 	/* Thread init */
 	int n;
 	for (n=0; n<num_threads; n++){
@@ -166,7 +294,10 @@ struct thpool_* thpool_init(int num_threads){
 	}
 
 	/* Wait for threads to initialize */
-	while (thpool_p->num_threads_alive != num_threads) {}
+	int alive;
+	while ((alive = atomic_load(&thpool_p->num_threads_alive)) != num_threads){
+		futex_wait(&thpool_p->num_threads_alive, alive);
+	}
 
 	return thpool_p;
 }
@@ -174,32 +305,133 @@ struct thpool_* thpool_init(int num_threads){
 
 /* Add work to the thread pool */
 int thpool_add_work(thpool_* thpool_p, void (*function_p)(void*), void* arg_p){
-	job* newjob;
+	return thpool_add_work_batch(thpool_p, function_p, &arg_p, 1);
+}
 
-	newjob=(struct job*)malloc(sizeof(struct job));
-	if (newjob==NULL){
-		err("thpool_add_work(): Could not allocate memory for new job\n");
-		return -1;
+
+/* Add n jobs running the same function to the thread pool */
+int thpool_add_work_batch(thpool_* thpool_p, void (*function_p)(void*), void** args_p, int n){
+
+	/* add jobs to queue, as many at a time as there are free slots; while it
+	 * is full, wait for the threads to work it down to half full (pushing
+	 * into every slot as soon as it frees would wake a thread per job) */
+	jobqueue* jobqueue_p = &thpool_p->jobqueue;
+
+	/* count the jobs before any can finish */
+	if (n > 0){
+		atomic_fetch_add(&thpool_p->num_jobs_pending, n);
 	}
 
-	/* add function and argument */
-	newjob->function=function_p;
-	newjob->arg=arg_p;
+	/* jobs added by one of the pool's own threads go on its deque first,
+	 * where it runs them itself unless an idle thread steals them */
+	int own_thread = this_thread != NULL && this_thread->thpool_p == thpool_p;
+	if (own_thread && n > 0){
+		int pushed = deque_push(&this_thread->deque, function_p, args_p, n);
+		if (pushed > 0){
+			/* order the jobs before the check for a thread to take them */
+			atomic_thread_fence(memory_order_seq_cst);
+			jobqueue_wake(jobqueue_p);
+		}
+		args_p += pushed;
+		n      -= pushed;
+	}
 
-	/* add job to queue */
-	jobqueue_push(&thpool_p->jobqueue, newjob);
+	while (n > 0){
+		int pushed = jobqueue_push(jobqueue_p, function_p, args_p, n);
+		if (pushed == 0 && own_thread){
+			/* waiting for the threads to make room could mean waiting for
+			 * ourselves, so run the job here instead */
+			function_p(args_p[0]);
+			thpool_jobs_done(thpool_p, 1);
+			pushed = 1;
+		}
+		else if (pushed == 0){
+			atomic_fetch_add(&jobqueue_p->num_pushers_waiting, 1);
+			pushed = jobqueue_push(jobqueue_p, function_p, args_p, n);
+			if (pushed == 0){
+				csem_wait(&jobqueue_p->has_space);
+			}
+			atomic_fetch_sub(&jobqueue_p->num_pushers_waiting, 1);
+		}
+		args_p += pushed;
+		n      -= pushed;
+	}
 
 	return 0;
 }
 
 
+/* Run a range in chunks on the thread pool and the calling thread */
+void thpool_parallel_for(thpool_* thpool_p, int begin, int end, int grain,
+                         void (*function_p)(void* ctx, int begin, int end), void* ctx){
+	if (end <= begin) return;
+
+	int num_threads = atomic_load(&thpool_p->num_threads_alive);
+	if (grain <= 0){
+		/* a few chunks per thread, so a slow chunk does not hold up the rest */
+		grain = (int)(((long)end - begin) / (8 * (num_threads + 1)));
+		if (grain < 1) grain = 1;
+	}
+	int chunks  = (int)(((long)end - begin + grain - 1) / grain);
+	int helpers = chunks - 1 < num_threads ? chunks - 1 : num_threads;
+
+	range* range_p = (struct range*)malloc(sizeof(struct range) + helpers * sizeof(void*));
+	if (range_p == NULL){
+		err("thpool_parallel_for(): Could not allocate memory for range, running it on the caller\n");
+		function_p(ctx, begin, end);
+		return;
+	}
+	range_p->function = function_p;
+	range_p->ctx      = ctx;
+	range_p->begin    = begin;
+	range_p->end      = end;
+	range_p->grain    = grain;
+	range_p->chunks   = chunks;
+	atomic_init(&range_p->next_chunk, 0);
+	atomic_init(&range_p->chunks_done, 0);
+	atomic_init(&range_p->refs, helpers + 1);
+	csem_init(&range_p->done, 0, thpool_p->max_spins);
+
+	/* one helper job per thread that can be kept busy */
+	int n;
+	for (n=0; n<helpers; n++){
+		range_p->helpers[n] = range_p;
+	}
+	thpool_add_work_batch(thpool_p, range_help, range_p->helpers, helpers);
+
+	/* the caller takes chunks too, then waits for those still running */
+	range_run(range_p);
+	if (atomic_load(&range_p->chunks_done) < chunks){
+		csem_wait(&range_p->done);
+	}
+	range_release(range_p);
+}
+
+
 /* Wait until all jobs have finished */
 void thpool_wait(thpool_* thpool_p){
-	pthread_mutex_lock(&thpool_p->thcount_lock);
-	while (thpool_p->jobqueue.len || thpool_p->num_threads_working) {
-		pthread_cond_wait(&thpool_p->threads_all_idle, &thpool_p->thcount_lock);
+	int n;
+	for (n=0; n<thpool_p->max_spins; n++){
+		if (atomic_load(&thpool_p->num_jobs_pending) == 0) return;
+		cpu_relax();
+	}
+
+	/* the thread finishing the last job wakes us if it sees us waiting */
+	atomic_fetch_add(&thpool_p->num_waiting, 1);
+	int pending;
+	while ((pending = atomic_load(&thpool_p->num_jobs_pending)) != 0){
+		futex_wait(&thpool_p->num_jobs_pending, pending);
+	}
+	atomic_fetch_sub(&thpool_p->num_waiting, 1);
+}
+
+
+/* Count n jobs as done, waking thpool_wait if they were the last ones */
+static void thpool_jobs_done(thpool_* thpool_p, int n){
+	if (atomic_fetch_sub(&thpool_p->num_jobs_pending, n) == n
+	    && atomic_load(&thpool_p->num_waiting) > 0){
+		futex_wake(&thpool_p->num_jobs_pending, INT_MAX);
 	}
-	pthread_mutex_unlock(&thpool_p->thcount_lock);
 }
 
 
@@ -208,26 +440,16 @@ void thpool_destroy(thpool_* thpool_p){
 	/* No need to destory if it's NULL */
 	if (thpool_p == NULL) return ;
 
-	volatile int threads_total = thpool_p->num_threads_alive;
+	int threads_total = atomic_load(&thpool_p->num_threads_alive);
 
 	/* End each thread 's infinite loop */
-	threads_keepalive = 0;
-
-	/* Give one second to kill idle threads */
-	double TIMEOUT = 1.0;
-	time_t start, end;
-	double tpassed = 0.0;
-	time (&start);
-	while (tpassed < TIMEOUT && thpool_p->num_threads_alive){
-		bsem_post_all(thpool_p->jobqueue.has_jobs);
-		time (&end);
-		tpassed = difftime(end,start);
-	}
-
-	/* Poll remaining threads */
-	while (thpool_p->num_threads_alive){
-		bsem_post_all(thpool_p->jobqueue.has_jobs);
-		sleep(1);
+	thpool_p->threads_keepalive = 0;
+
+	/* Wake every idle thread and wait for the last one to exit */
+	csem_post(&thpool_p->jobqueue.has_jobs, threads_total);
+	int alive;
+	while ((alive = atomic_load(&thpool_p->num_threads_alive)) != 0){
+		futex_wait(&thpool_p->num_threads_alive, alive);
 	}
 
 	/* Job queue cleanup */
@@ -244,8 +466,9 @@ void thpool_destroy(thpool_* thpool_p){
 
 /* Pause all threads in threadpool */
 void thpool_pause(thpool_* thpool_p) {
+	thpool_p->threads_on_hold = 1;
 	int n;
-	for (n=0; n < thpool_p->num_threads_alive; n++){
+	for (n=0; n < atomic_load(&thpool_p->num_threads_alive); n++){
 		pthread_kill(thpool_p->threads[n]->pthread, SIGUSR1);
 	}
 }
@@ -253,17 +476,12 @@ void thpool_pause(thpool_* thpool_p) {
 
 /* Resume all threads in threadpool */
 void thpool_resume(thpool_* thpool_p) {
-    // resuming a single threadpool hasn't been
-    // implemented yet, meanwhile this supresses
-    // the warnings
-    (void)thpool_p;
-
-	threads_on_hold = 0;
+	thpool_p->threads_on_hold = 0;
 }
 
 
 int thpool_num_threads_working(thpool_* thpool_p){
-	return thpool_p->num_threads_working;
+	return atomic_load(&thpool_p->num_threads_working);
 }
 
 
@@ -289,6 +507,8 @@ static int thread_init (thpool_* thpool_p, struct thread** thread_p, int id){
 
 	(*thread_p)->thpool_p = thpool_p;
 	(*thread_p)->id       = id;
+	(*thread_p)->seed     = id + 1;
+	deque_init(&(*thread_p)->deque);
 
 	pthread_create(&(*thread_p)->pthread, NULL, (void * (*)(void *)) thread_do, (*thread_p));
 	pthread_detach((*thread_p)->pthread);
@@ -296,11 +516,14 @@ static int thread_init (thpool_* thpool_p, struct thread** thread_p, int id){
 }
 
 
-/* Sets the calling thread on hold */
+/* Sets the calling thread on hold until its pool is resumed
+ *
+ * Runs as the SIGUSR1 handler, on the pool thread thpool_pause signalled.
+ */
 static void thread_hold(int sig_id) {
     (void)sig_id;
-	threads_on_hold = 1;
-	while (threads_on_hold){
+	thpool_* thpool_p = this_thread->thpool_p;
+	while (thpool_p->threads_on_hold){
 		sleep(1);
 	}
 }
@@ -332,6 +555,8 @@ static void* thread_do(struct thread* thread_p){
 	/* Assure all threads have been created before starting serving */
 	thpool_* thpool_p = thread_p->thpool_p;
 
+	this_thread = thread_p;
+
 	/* Register signal handler */
 	struct sigaction act;
 	sigemptyset(&act.sa_mask);
@@ -342,43 +567,47 @@ static void* thread_do(struct thread* thread_p){
 	}
 
 	/* Mark thread as alive (initialized) */
-	pthread_mutex_lock(&thpool_p->thcount_lock);
-	thpool_p->num_threads_alive += 1;
-	pthread_mutex_unlock(&thpool_p->thcount_lock);
+	atomic_fetch_add(&thpool_p->num_threads_alive, 1);
+	futex_wake(&thpool_p->num_threads_alive, INT_MAX);
 
-	while(threads_keepalive){
+	while(thpool_p->threads_keepalive){
 
-		bsem_wait(thpool_p->jobqueue.has_jobs);
+		csem_wait(&thpool_p->jobqueue.has_jobs);
 
-		if (threads_keepalive){
+		if (thpool_p->threads_keepalive){
 
-			pthread_mutex_lock(&thpool_p->thcount_lock);
-			thpool_p->num_threads_working++;
-			pthread_mutex_unlock(&thpool_p->thcount_lock);
+			atomic_fetch_add(&thpool_p->num_threads_working, 1);
 
-			/* Read job from queue and execute it */
+			/* Take jobs and execute them until there are none left to take,
+			 * first waking one more thread if there are jobs left to share;
+			 * they are counted as done together, once there are none left */
 			void (*func_buff)(void*);
 			void*  arg_buff;
-			job* job_p = jobqueue_pull(&thpool_p->jobqueue);
-			if (job_p) {
-				func_buff = job_p->function;
-				arg_buff  = job_p->arg;
+			job job_buff;
+			int woke_next = 0;
+			int num_done  = 0;
+			while (thpool_p->threads_keepalive && thread_next_job(thread_p, &job_buff)) {
+				if (!woke_next && thpool_p->jobqueue.len > 0) {
+					csem_post_upto(&thpool_p->jobqueue.has_jobs, 1);
+					woke_next = 1;
+				}
+				func_buff = job_buff.function;
+				arg_buff  = job_buff.arg;
 				func_buff(arg_buff);
-				free(job_p);
+				num_done++;
 			}
-
-			pthread_mutex_lock(&thpool_p->thcount_lock);
-			thpool_p->num_threads_working--;
-			if (!thpool_p->num_threads_working) {
-				pthread_cond_signal(&thpool_p->threads_all_idle);
+			atomic_fetch_sub(&thpool_p->num_threads_working, 1);
+			if (num_done > 0){
+				thpool_jobs_done(thpool_p, num_done);
 			}
-			pthread_mutex_unlock(&thpool_p->thcount_lock);
 
 		}
 	}
-	pthread_mutex_lock(&thpool_p->thcount_lock);
-	thpool_p->num_threads_alive --;
-	pthread_mutex_unlock(&thpool_p->thcount_lock);
+
+	/* the pool may be freed as soon as the count reaches 0 */
+	if (atomic_fetch_sub(&thpool_p->num_threads_alive, 1) == 1){
+		futex_wake(&thpool_p->num_threads_alive, INT_MAX);
+	}
 
 	return NULL;
 }
@@ -390,6 +619,36 @@ static void thread_destroy (thread* thread_p){
 }
 
 
+/* Get the next job for a thread: the newest from its own deque, else the
+ * oldest from the job queue, else one stolen from another thread
+ *
+ * @return 1 if a job was copied to job_p, 0 if there was none to take
+ */
+static int thread_next_job(thread* thread_p, job* job_p){
+	return deque_pop(&thread_p->deque, job_p)
+	    || jobqueue_pull(&thread_p->thpool_p->jobqueue, job_p)
+	    || thread_steal(thread_p, job_p);
+}
+
+
+/* Try every other thread's deque once, starting from a random one */
+static int thread_steal(thread* thread_p, job* job_p){
+	thpool_* thpool_p = thread_p->thpool_p;
+	int num_threads = thpool_p->num_threads;
+	if (num_threads < 2) return 0;
+
+	int start = rand_r(&thread_p->seed) % num_threads;
+	int n;
+	for (n=0; n<num_threads; n++){
+		thread* victim_p = thpool_p->threads[(start + n) % num_threads];
+		if (victim_p != thread_p && victim_p != NULL && deque_steal(&victim_p->deque, job_p)){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
 
 
 
@@ -397,18 +656,24 @@ static void thread_destroy (thread* thread_p){
 
 
 /* Initialize queue */
-static int jobqueue_init(jobqueue* jobqueue_p){
-	jobqueue_p->len = 0;
-	jobqueue_p->front = NULL;
-	jobqueue_p->rear  = NULL;
-
-	jobqueue_p->has_jobs = (struct bsem*)malloc(sizeof(struct bsem));
-	if (jobqueue_p->has_jobs == NULL){
+static int jobqueue_init(jobqueue* jobqueue_p, int max_spins){
+	jobqueue_p->slots = (struct jobslot*)malloc(THPOOL_QUEUE_SIZE * sizeof(struct jobslot));
+	if (jobqueue_p->slots == NULL){
 		return -1;
 	}
 
-	pthread_mutex_init(&(jobqueue_p->rwmutex), NULL);
-	bsem_init(jobqueue_p->has_jobs, 0);
+	size_t n;
+	for (n=0; n<THPOOL_QUEUE_SIZE; n++){
+		atomic_init(&jobqueue_p->slots[n].sequence, n);
+	}
+	jobqueue_p->mask = THPOOL_QUEUE_SIZE - 1;
+	atomic_init(&jobqueue_p->rear, 0);
+	atomic_init(&jobqueue_p->front, 0);
+	atomic_init(&jobqueue_p->len, 0);
+	atomic_init(&jobqueue_p->num_pushers_waiting, 0);
+
+	csem_init(&jobqueue_p->has_jobs, 0, max_spins);
+	csem_init(&jobqueue_p->has_space, 0, max_spins);
 
 	return 0;
 }
@@ -417,80 +682,253 @@ static int jobqueue_init(jobqueue* jobqueue_p){
 /* Clear the queue */
 static void jobqueue_clear(jobqueue* jobqueue_p){
 
-	while(jobqueue_p->len){
-		free(jobqueue_pull(jobqueue_p));
+	job job_buff;
+	while(jobqueue_pull(jobqueue_p, &job_buff));
+
+	atomic_store(&jobqueue_p->has_jobs.count, 0);
+	atomic_store(&jobqueue_p->len, 0);
+
+}
+
+
+/* Add up to n jobs to queue (copies them into slots, nothing is allocated)
+ *
+ * Claims the longest run of free slots, up to n, with a single
+ * compare-and-swap and wakes a thread for them at most once.
+ *
+ * @return the number of jobs added, 0 if every slot is taken
+ */
+static int jobqueue_push(jobqueue* jobqueue_p, void (*function_p)(void*), void** args_p, int n){
+
+	size_t pos = atomic_load_explicit(&jobqueue_p->rear, memory_order_relaxed);
+	int num_free;
+	for (;;){
+		/* count the free slots from pos on */
+		intptr_t dif = 0;
+		for (num_free = 0; num_free < n; num_free++){
+			jobslot* slot = &jobqueue_p->slots[(pos + num_free) & jobqueue_p->mask];
+			size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+			dif = (intptr_t)seq - (intptr_t)(pos + num_free);
+			if (dif != 0) break;
+		}
+
+		if (num_free > 0){
+			/* claim the free positions */
+			if (atomic_compare_exchange_weak_explicit(&jobqueue_p->rear, &pos, pos + num_free,
+			                                          memory_order_relaxed, memory_order_relaxed)){
+				break;
+			}
+		}
+		else if (dif < 0){
+			/* queue is full */
+			return 0;
+		}
+		else {
+			/* another thread pushed here first */
+			pos = atomic_load_explicit(&jobqueue_p->rear, memory_order_relaxed);
+		}
 	}
 
-	jobqueue_p->front = NULL;
-	jobqueue_p->rear  = NULL;
-	bsem_reset(jobqueue_p->has_jobs);
-	jobqueue_p->len = 0;
+	int n_pushed;
+	for (n_pushed = 0; n_pushed < num_free; n_pushed++){
+		jobslot* slot = &jobqueue_p->slots[(pos + n_pushed) & jobqueue_p->mask];
+		slot->job.function = function_p;
+		slot->job.arg      = args_p[n_pushed];
+		atomic_store_explicit(&slot->sequence, pos + n_pushed + 1, memory_order_release);
+	}
 
+	/* the seq_cst update of len orders the jobs before the wake up check */
+	atomic_fetch_add(&jobqueue_p->len, num_free);
+	jobqueue_wake(jobqueue_p);
+
+	return num_free;
 }
 
 
-/* Add (allocated) job to queue
+/* Get first job from queue (removes it from queue)
+ *
+ * @return 1 if a job was copied to job_p, 0 if the queue was empty
  */
-static void jobqueue_push(jobqueue* jobqueue_p, struct job* newjob){
+static int jobqueue_pull(jobqueue* jobqueue_p, struct job* job_p){
+
+	jobslot* slot;
+	size_t pos = atomic_load_explicit(&jobqueue_p->front, memory_order_relaxed);
+	for (;;){
+		slot = &jobqueue_p->slots[pos & jobqueue_p->mask];
+		size_t seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+		if (dif == 0){
+			/* slot holds a job: claim the position */
+			if (atomic_compare_exchange_weak_explicit(&jobqueue_p->front, &pos, pos + 1,
+			                                          memory_order_relaxed, memory_order_relaxed)){
+				break;
+			}
+		}
+		else if (dif < 0){
+			/* queue is empty */
+			return 0;
+		}
+		else {
+			/* another thread pulled from here first */
+			pos = atomic_load_explicit(&jobqueue_p->front, memory_order_relaxed);
+		}
+	}
+
+	*job_p = slot->job;
+	/* hand the slot back to the push one lap ahead */
+	atomic_store_explicit(&slot->sequence, pos + jobqueue_p->mask + 1, memory_order_release);
+
+	int len = atomic_fetch_sub(&jobqueue_p->len, 1) - 1;
+
+	/* let waiting pushers refill the queue once it is down to half full */
+	int num_pushers = atomic_load(&jobqueue_p->num_pushers_waiting);
+	if (len <= THPOOL_QUEUE_SIZE / 2 && num_pushers){
+		csem_post_upto(&jobqueue_p->has_space, num_pushers);
+	}
+
+	return 1;
+}
 
-	pthread_mutex_lock(&jobqueue_p->rwmutex);
-	newjob->prev = NULL;
 
-	switch(jobqueue_p->len){
+/* Wake a thread for new jobs; it wakes the next if there are jobs left
+ * (waking a thread per job woke every idle thread on each batch, most of
+ * them only to find the queue already drained) */
+static void jobqueue_wake(jobqueue* jobqueue_p){
+	csem_post_upto(&jobqueue_p->has_jobs, 1);
+}
 
-		case 0:  /* if no jobs in queue */
-					jobqueue_p->front = newjob;
-					jobqueue_p->rear  = newjob;
-					break;
 
-		default: /* if jobs in queue */
-					jobqueue_p->rear->prev = newjob;
-					jobqueue_p->rear = newjob;
+/* Free all queue resources back to the system */
+static void jobqueue_destroy(jobqueue* jobqueue_p){
+	jobqueue_clear(jobqueue_p);
+	free(jobqueue_p->slots);
+}
 
+
+
+
+
+/* ============================== DEQUE ============================= */
+
+
+/* Initialize deque */
+static void deque_init(deque* deque_p){
+	atomic_init(&deque_p->top, 0);
+	atomic_init(&deque_p->bottom, 0);
+	int n;
+	for (n=0; n<THPOOL_DEQUE_SIZE; n++){
+		atomic_init(&deque_p->slots[n].function, NULL);
+		atomic_init(&deque_p->slots[n].arg, NULL);
+	}
+}
+
+
+/* Push up to n jobs at the bottom (owner only)
+ *
+ * @return the number of jobs pushed, fewer than n if the deque filled up
+ */
+static int deque_push(deque* deque_p, void (*function_p)(void*), void** args_p, int n){
+	long b = atomic_load_explicit(&deque_p->bottom, memory_order_relaxed);
+	long t = atomic_load_explicit(&deque_p->top, memory_order_acquire);
+	int num_free = THPOOL_DEQUE_SIZE - (int)(b - t);
+	if (n > num_free) n = num_free;
+
+	int i;
+	for (i=0; i<n; i++){
+		dequeslot* slot = &deque_p->slots[(b + i) & (THPOOL_DEQUE_SIZE - 1)];
+		atomic_store_explicit(&slot->function, function_p, memory_order_relaxed);
+		atomic_store_explicit(&slot->arg, args_p[i], memory_order_relaxed);
+	}
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&deque_p->bottom, b + n, memory_order_relaxed);
+	return n;
+}
+
+
+/* Pop the newest job from the bottom (owner only)
+ *
+ * @return 1 if a job was copied to job_p, 0 if the deque was empty
+ */
+static int deque_pop(deque* deque_p, job* job_p){
+	long b = atomic_load_explicit(&deque_p->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&deque_p->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long t = atomic_load_explicit(&deque_p->top, memory_order_relaxed);
+	if (t > b){
+		atomic_store_explicit(&deque_p->bottom, b + 1, memory_order_relaxed);
+		return 0;
+	}
+
+	dequeslot* slot = &deque_p->slots[b & (THPOOL_DEQUE_SIZE - 1)];
+	job_p->function = atomic_load_explicit(&slot->function, memory_order_relaxed);
+	job_p->arg      = atomic_load_explicit(&slot->arg, memory_order_relaxed);
+	if (t < b){
+		return 1;
 	}
-	jobqueue_p->len++;
 
-	bsem_post(jobqueue_p->has_jobs);
-	pthread_mutex_unlock(&jobqueue_p->rwmutex);
+	/* the last job: race the thieves for it */
+	int won = atomic_compare_exchange_strong_explicit(&deque_p->top, &t, t + 1,
+	                                                  memory_order_seq_cst, memory_order_relaxed);
+	atomic_store_explicit(&deque_p->bottom, b + 1, memory_order_relaxed);
+	return won;
 }
 
 
-/* Get first job from queue(removes it from queue)
- * Notice: Caller MUST hold a mutex
+/* Steal the oldest job from the top (any thread)
+ *
+ * @return 1 if a job was copied to job_p, 0 if the deque was empty or
+ *         another thread took the job first
  */
-static struct job* jobqueue_pull(jobqueue* jobqueue_p){
+static int deque_steal(deque* deque_p, job* job_p){
+	long t = atomic_load_explicit(&deque_p->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long b = atomic_load_explicit(&deque_p->bottom, memory_order_acquire);
+	if (t >= b){
+		return 0;
+	}
 
-	pthread_mutex_lock(&jobqueue_p->rwmutex);
-	job* job_p = jobqueue_p->front;
+	dequeslot* slot = &deque_p->slots[t & (THPOOL_DEQUE_SIZE - 1)];
+	job_p->function = atomic_load_explicit(&slot->function, memory_order_relaxed);
+	job_p->arg      = atomic_load_explicit(&slot->arg, memory_order_relaxed);
+	return atomic_compare_exchange_strong_explicit(&deque_p->top, &t, t + 1,
+	                                               memory_order_seq_cst, memory_order_relaxed);
+}
 
-	switch(jobqueue_p->len){
 
-		case 0:  /* if no jobs in queue */
-		  			break;
 
-		case 1:  /* if one job in queue */
-					jobqueue_p->front = NULL;
-					jobqueue_p->rear  = NULL;
-					jobqueue_p->len = 0;
-					break;
 
-		default: /* if >1 jobs in queue */
-					jobqueue_p->front = job_p->prev;
-					jobqueue_p->len--;
-					/* more than one job in queue -> post it */
-					bsem_post(jobqueue_p->has_jobs);
 
+/* ============================== RANGE ============================= */
+
+
+/* Run chunks of the range until none are left */
+static void range_run(range* range_p){
+	int chunk;
+	while ((chunk = atomic_fetch_add(&range_p->next_chunk, 1)) < range_p->chunks){
+		int begin = (int)(range_p->begin + (long)chunk * range_p->grain);
+		int end   = (long)range_p->end - begin > range_p->grain ? begin + range_p->grain : range_p->end;
+		range_p->function(range_p->ctx, begin, end);
+
+		if (atomic_fetch_add(&range_p->chunks_done, 1) + 1 == range_p->chunks){
+			csem_post(&range_p->done, 1);
+		}
 	}
+}
+
 
-	pthread_mutex_unlock(&jobqueue_p->rwmutex);
-	return job_p;
+/* Helper job of thpool_parallel_for */
+static void range_help(void* arg){
+	range_run((struct range*)arg);
+	range_release((struct range*)arg);
 }
 
 
-/* Free all queue resources back to the system */
-static void jobqueue_destroy(jobqueue* jobqueue_p){
-	jobqueue_clear(jobqueue_p);
-	free(jobqueue_p->has_jobs);
+/* Free the range once the caller and every helper are done with it */
+static void range_release(range* range_p){
+	if (atomic_fetch_sub(&range_p->refs, 1) == 1){
+		free(range_p);
+	}
 }
 
 
@@ -500,48 +938,137 @@ static void jobqueue_destroy(jobqueue* jobqueue_p){
 /* ======================== SYNCHRONISATION ========================= */
 
 
-/* Init semaphore to 1 or 0 */
-static void bsem_init(bsem *bsem_p, int value) {
-	if (value < 0 || value > 1) {
-		err("bsem_init(): Binary semaphore can take only values 1 or 0");
-		exit(1);
+#if defined(__linux__)
+
+/* Sleep while *addr holds value (returns early on a wake or a signal) */
+static void futex_wait(atomic_int* addr, int value){
+	syscall(SYS_futex, (int*)addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+
+/* Wake up to n threads sleeping on addr */
+static void futex_wake(atomic_int* addr, int n){
+	syscall(SYS_futex, (int*)addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+#else
+
+/* Without futexes, every address shares one condition variable. Its mutex
+ * is shared by all pools, so thpool_pause's signal is held off while it is
+ * locked: a thread put on hold with it locked would stop every pool. */
+static pthread_mutex_t futex_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  futex_cond  = PTHREAD_COND_INITIALIZER;
+
+
+/* Lock the shared mutex, blocking SIGUSR1 until futex_unlock */
+static void futex_lock(sigset_t* old_p){
+	sigset_t block;
+	sigemptyset(&block);
+	sigaddset(&block, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &block, old_p);
+	pthread_mutex_lock(&futex_mutex);
+}
+
+
+static void futex_unlock(sigset_t* old_p){
+	pthread_mutex_unlock(&futex_mutex);
+	pthread_sigmask(SIG_SETMASK, old_p, NULL);
+}
+
+
+/* Sleep while *addr holds value (returns early on any wake) */
+static void futex_wait(atomic_int* addr, int value){
+	sigset_t old;
+	futex_lock(&old);
+	if (atomic_load(addr) == value){
+		pthread_cond_wait(&futex_cond, &futex_mutex);
 	}
-	pthread_mutex_init(&(bsem_p->mutex), NULL);
-	pthread_cond_init(&(bsem_p->cond), NULL);
-	bsem_p->v = value;
+	futex_unlock(&old);
+}
+
+
+/* Wake the threads sleeping on addr (and any others) */
+static void futex_wake(atomic_int* addr, int n){
+	(void)addr;
+	(void)n;
+	sigset_t old;
+	futex_lock(&old);
+	pthread_cond_broadcast(&futex_cond);
+	futex_unlock(&old);
+}
+
+#endif
+
+
+/* Init semaphore to value */
+static void csem_init(csem *csem_p, int value, int max_spins) {
+	atomic_init(&csem_p->count, value);
+	atomic_init(&csem_p->waiters, 0);
+	atomic_init(&csem_p->spins, 0);
+	csem_p->max_spins = max_spins;
 }
 
 
-/* Reset semaphore to 0 */
-static void bsem_reset(bsem *bsem_p) {
-	bsem_init(bsem_p, 0);
+/* Post n times, waking sleeping threads to take the posts */
+static void csem_post(csem *csem_p, int n) {
+	atomic_fetch_add(&csem_p->count, n);
+	if (atomic_load(&csem_p->waiters) > 0){
+		futex_wake(&csem_p->count, n);
+	}
 }
 
 
-/* Post to at least one thread */
-static void bsem_post(bsem *bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	bsem_p->v = 1;
-	pthread_cond_signal(&bsem_p->cond);
-	pthread_mutex_unlock(&bsem_p->mutex);
+/* Post until there are at least n posts not yet taken
+ *
+ * A post that is already there is taken after this call, so the thread
+ * taking it sees what the caller did before (as long as that is ordered
+ * before the load of count, e.g. by a seq_cst update).
+ */
+static void csem_post_upto(csem *csem_p, int n) {
+	int count = atomic_load(&csem_p->count);
+	if (count < n){
+		csem_post(csem_p, n - count);
+	}
 }
 
 
-/* Post to all threads */
-static void bsem_post_all(bsem *bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	bsem_p->v = 1;
-	pthread_cond_broadcast(&bsem_p->cond);
-	pthread_mutex_unlock(&bsem_p->mutex);
+/* Take a post if there is one
+ *
+ * @return 1 if a post was taken, 0 otherwise
+ */
+static int csem_trywait(csem *csem_p) {
+	int count = atomic_load(&csem_p->count);
+	while (count > 0){
+		if (atomic_compare_exchange_weak(&csem_p->count, &count, count - 1)){
+			return 1;
+		}
+	}
+	return 0;
 }
 
 
-/* Wait on semaphore until semaphore has value 0 */
-static void bsem_wait(bsem* bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	while (bsem_p->v != 1) {
-		pthread_cond_wait(&bsem_p->cond, &bsem_p->mutex);
+/* Wait for a post and take it
+ *
+ * Spins for up to twice as long as waits have recently spun (as glibc's
+ * adaptive mutexes do), bounded by max_spins, then sleeps until a post.
+ */
+static void csem_wait(csem* csem_p) {
+	if (csem_trywait(csem_p)) return;
+
+	int spins = atomic_load_explicit(&csem_p->spins, memory_order_relaxed);
+	int limit = 2 * spins + 10;
+	if (limit > csem_p->max_spins) limit = csem_p->max_spins;
+	int n, taken = 0;
+	for (n=0; n<limit && !taken; n++){
+		cpu_relax();
+		taken = csem_trywait(csem_p);
+	}
+	atomic_store_explicit(&csem_p->spins, spins + (n - spins) / 8, memory_order_relaxed);
+	if (taken) return;
+
+	atomic_fetch_add(&csem_p->waiters, 1);
+	while (!csem_trywait(csem_p)){
+		futex_wait(&csem_p->count, 0);
 	}
-	bsem_p->v = 0;
-	pthread_mutex_unlock(&bsem_p->mutex);
+	atomic_fetch_sub(&csem_p->waiters, 1);
 }
@@ -23,6 +23,9 @@ typedef struct thpool_* threadpool;
  * Initializes a threadpool. This function will not return until all
  * threads have initialized successfully.
  *
+ * Every threadpool is independent: others can be created, paused, resumed
+ * and destroyed while it runs.
+ *
  * @example
  *
  *    ..
@@ -46,6 +49,16 @@ threadpool thpool_init(int num_threads);
  *
  * NOTICE: You have to cast both the function and argument to not get warnings.
  *
+ * The job queue holds THPOOL_QUEUE_SIZE jobs (4096 unless defined otherwise
+ * when compiling thpool.c). Nothing is allocated per job; if the queue is
+ * full the call waits until the threads have worked it down to half full.
+ *
+ * Work added by a job running on the pool goes on its thread's own deque
+ * (THPOOL_DEQUE_SIZE jobs, 256 by default), which that thread works through
+ * newest first while idle threads steal from it. Such a call never waits:
+ * a job that fits neither on the deque nor in the queue is run there and
+ * then.
+ *
  * @example
  *
  *    void print_num(int num){
@@ -67,6 +80,67 @@ threadpool thpool_init(int num_threads);
 int thpool_add_work(threadpool, void (*function_p)(void*), void* arg_p);
 
 
+/**
+ * @brief Add a batch of work to the job queue
+ *
+ * Adds n jobs that call the same function, one with each of the n arguments
+ * in args_p. Runs of free slots in the job queue are claimed and the threads
+ * are woken once for all the jobs, rather than once per job as when calling
+ * thpool_add_work n times. Like thpool_add_work, waits while the queue is
+ * full.
+ *
+ * @example
+ *
+ *    void blur_row(void* row);
+ *    ..
+ *    void* rows[HEIGHT];
+ *    for (int y=0; y<HEIGHT; y++) rows[y] = &row_args[y];
+ *    thpool_add_work_batch(thpool, blur_row, rows, HEIGHT);
+ *    thpool_wait(thpool);
+ *    ..
+ *
+ * @param  threadpool    threadpool to which the work will be added
+ * @param  function_p    pointer to function to add as work
+ * @param  args_p        array of n pointers, the argument of each job
+ * @param  n             number of jobs to add
+ * @return 0 on success, -1 otherwise.
+ */
+int thpool_add_work_batch(threadpool, void (*function_p)(void*), void** args_p, int n);
+
+
+/**
+ * @brief Run a loop over a range in parallel
+ *
+ * Cuts [begin, end) into chunks of grain indices and calls function_p once
+ * per chunk with ctx and the chunk's bounds. The chunks are handed out to
+ * the threads of the pool and to the calling thread, which returns once
+ * every chunk has finished. Only this call's chunks are waited for, so
+ * other work in the pool is not affected, and it can be called from a job
+ * running on the pool itself.
+ *
+ * With grain <= 0 a grain giving each thread a few chunks is picked.
+ *
+ * @example
+ *
+ *    void invert_rows(void* pic, int begin, int end){
+ *       ..
+ *    }
+ *    ..
+ *    thpool_parallel_for(thpool, 0, height, 16, invert_rows, pic);
+ *    ..
+ *
+ * @param  threadpool    threadpool sharing out the chunks
+ * @param  begin         first index of the range
+ * @param  end           index one past the end of the range
+ * @param  grain         number of indices per chunk, or <= 0
+ * @param  function_p    function called with ctx and each chunk's bounds
+ * @param  ctx           first argument of function_p
+ * @return nothing
+ */
+void thpool_parallel_for(threadpool, int begin, int end, int grain,
+                         void (*function_p)(void* ctx, int begin, int end), void* ctx);
+
+
 /**
  * @brief Wait for all queued jobs to finish
  *
@@ -74,11 +148,9 @@ int thpool_add_work(threadpool, void (*function_p)(void*), void* arg_p);
  * Once the queue is empty and all work has completed, the calling thread
  * (probably the main program) will continue.
  *
- * Smart polling is used in wait. The polling is initially 0 - meaning that
- * there is virtually no polling at all. If after 1 seconds the threads
- * haven't finished, the polling interval starts growing exponentially
- * until it reaches max_secs seconds. Then it jumps down to a maximum polling
- * interval assuming that heavy processing is being used in the threadpool.
+ * The pool counts the jobs added and not yet finished. Wait spins on that
+ * count for a few microseconds (on machines with more than one processor),
+ * then sleeps until the thread finishing the last job wakes it.
  *
  * @example
  *